@@ -0,0 +1,29 @@
+#ifndef CONTINUATION_H
+#define CONTINUATION_H
+
+#include <vector>
+using namespace std;
+
+class continuation {
+// Tracks the fringe minimum along an outer scan axis (pulse width, phi...) and
+// predicts where the next fringe's minimum is by extrapolating the previous ones.
+// The search half width follows the prediction error, and widen() doubles it
+// when a fit turns out bad
+public:
+    continuation(const double wGuess, const double halfWidth, const double minHalfWidth,
+        const double maxHalfWidth);
+    double getCenter(const double x) const;  // Predicted minimum at outer scan value x
+    double getHalfWidth() const {return _halfWidth;}
+    bool widen();   // Doubles the half width, false if already at maxHalfWidth
+    void addMinimum(const double x, const double wMin);  // Fitted minimum wMin found at x
+private:
+    vector<double> _x, _wMin;
+    double _guess, _halfWidth, _minHalfWidth, _maxHalfWidth;
+};
+
+// True if the quadratic fit polyCoeff to fringe(wAdj) has its minimum well inside
+// the window and its rms residual is below tol times the fringe's range
+bool isGoodFit(const vector<double>& wAdj, const vector<double>& fringe,
+    const vector<double>& polyCoeff, const double tol);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef FOURIERFIT_H
+#define FOURIERFIT_H
+
+#include <vector>
+using namespace std;
+
+// Least squares fit of a truncated Fourier series of the given order to y(x),
+// y = c[0] + sum_k c[2k-1]*cos(k*x) + c[2k]*sin(k*x), k = 1...order
+// Needs at least 2*order + 1 distinct x values in one period
+vector<double> fourierFit(const vector<double>& x, const vector<double>& y, const int order);
+// Evaluates the series with coefficients c from fourierFit() at each x
+vector<double> fourierVal(const vector<double>& c, const vector<double>& x);
+
+#endif
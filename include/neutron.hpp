@@ -2,14 +2,30 @@
 #define NEUTRON_H
 
 #include <vector>
+#include <complex>
 using namespace std;
 
+class waveform;
+
 const double USE_LINEAR_RF = 0;
 const double USE_CIRCULAR_RF = 1;
 const int NUM_EQ = 4; // Number of equations in derivs
 const double PI  = 3.141592653589793238463;
 const double GAMMA_N = 1.83247172e8; // [s^-1 T^-1] gyromagnetic ratio of neutron
 
+class propagator {
+// 2x2 complex propagator U acting on the spinor (a,b), i.e.
+// (a',b') = U (a,b) with U = {{m[0][0], m[0][1]}, {m[1][0], m[1][1]}}
+public:
+    propagator();   // Identity
+    propagator(const complex<double> u00, const complex<double> u01,
+               const complex<double> u10, const complex<double> u11);
+    propagator operator*(const propagator& rhs) const;  // (U*V) applies V first, then U
+    propagator pow(unsigned long n) const;               // U^n by repeated squaring
+    vector<double> apply(const vector<double>& u) const; // Acts on u=(Re(a),Im(a),Re(b),Im(b))
+    complex<double> m[2][2];
+};
+
 class neutron {
 // vector<double> params should be in the form of {w, w0, wl, phi, INT_ID}
 // w is the driving RF frequency in rad/s
@@ -23,17 +39,36 @@ public:
     vector<double> getState();
     void larmorPrecess(double precTime, double w0);   // Analytical larmor precession
     void rkStep(const double t, const double dt, const vector<double>& params);
+    // RK4 step with the drive read from a phasor table (see waveform::getPhasorTable)
+    // rf[0,1], rf[2,3], rf[4,5] hold the drive at t, t + dt/2 and t + dt
+    void rkStep(const double dt, const double* rf, const vector<double>& params);
     void integrate(const double time, const double dt, const vector<double>& params);
     void integrate(const double time, const double dt, const vector<double>& params,
         vector<double>& tOut, vector<double>& xOut, vector<double>& yOut, vector<double>& zOut);
+    // Shaped/arbitrary RF pulse, drive precomputed on the step grid so no trig calls per step
+    void integrate(const double time, const double dt, const vector<double>& params, const waveform& rf);
+    // Same pulse as integrate(), but only one RF period 2pi/w is RK stepped. The
+    // full pulse is that period's propagator raised to a power plus a short remainder
+    void integrateFloquet(const double time, const double dt, const vector<double>& params);
+    // Propagator of the RF hamiltonian over [t0, t0 + time], using the smallest
+    // number of equal RK steps that are no longer than dt
+    propagator getPropagator(const double t0, const double time, const double dt,
+        const vector<double>& params);
+    void applyPropagator(const propagator& U) {_u = U.apply(_u);}
 private:
     // Systems to solve for linear/circular pi/2 pulses
     vector<double> derivs( const double t, const vector<double>& u, const vector<double>& params);
+    // rfCos, rfSin are the drive wRF*cos(w*t+phi), wRF*sin(w*t+phi) at the evaluation time
+    vector<double> derivs( const vector<double>& u, const double w0, const double rfCos,
+        const double rfSin, const double intId);
     vector<double> _u;  // State ket of neutron spin:  u=(Re(a),Im(a),Re(b),Im(b))
 };
 
 double getXProb(const vector<double>& u);  // Odds of measuring spin up along x
 double getYProb(const vector<double>& u);  // Odds of measuring spin up along y
 double getZProb(const vector<double>& u);  // Odds of measuring spin up along z
+// Analytical zProb after a circular RF pulse of length t, starting spin up
+double getCircRabiZProb(const double w, const double w0, const double wc, const double t);
+int getStepCount(const double time, const double dt);  // Number of RK steps integrate() takes
 
 #endif
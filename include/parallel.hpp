@@ -0,0 +1,113 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+inline int getNumThreads()  // Worker threads to use, one per hardware thread
+{
+    unsigned numThreads = thread::hardware_concurrency();
+    return numThreads > 0 ? (int)numThreads : 1;
+}
+
+class threadPool {
+// Worker threads started once and reused by every parallelFor(), so short jobs
+// (e.g. small simulation server queries) don't pay for starting threads.
+// The calling thread works too. One job runs at a time, calling parallelFor()
+// from inside func deadlocks
+public:
+    threadPool(const int numThreads)
+    {
+        _func = nullptr;
+        _n = 0;
+        _busy = 0;
+        _generation = 0;
+        _stop = false;
+        for (int j = 1; j < numThreads; j++)
+            _workers.push_back(thread(&threadPool::work, this));
+    }
+    ~threadPool()
+    {
+        {
+            lock_guard<mutex> lock(_lock);
+            _stop = true;
+        }
+        _start.notify_all();
+        for (auto &worker : _workers)
+            worker.join();
+    }
+    void parallelFor(const int n, const function<void(int)> &func)
+    // Calls func(i) for i = 0...n-1. Indices are handed out one at a time,
+    // so uneven work balances itself
+    {
+        lock_guard<mutex> job(_jobLock);
+        {
+            lock_guard<mutex> lock(_lock);
+            _func = &func;
+            _n = n;
+            _next = 0;
+            _busy = _workers.size();
+            _generation++;
+        }
+        _start.notify_all();
+        runJob();
+        unique_lock<mutex> lock(_lock);
+        _finish.wait(lock, [&]() { return _busy == 0; });
+    }
+    int getNumThreads() const {return _workers.size() + 1;}
+private:
+    void work()
+    {
+        unsigned long seen = 0;
+        unique_lock<mutex> lock(_lock);
+        while (true)
+        {
+            _start.wait(lock, [&]() { return _stop || _generation != seen; });
+            if (_stop)
+                return;
+            seen = _generation;
+            lock.unlock();
+            runJob();
+            lock.lock();
+            if (--_busy == 0)
+                _finish.notify_all();
+        }
+    }
+    void runJob()
+    {
+        for (int i = _next++; i < _n; i = _next++)
+            (*_func)(i);
+    }
+    vector<thread> _workers;
+    mutex _lock, _jobLock;
+    condition_variable _start, _finish;
+    const function<void(int)> *_func;
+    int _n;
+    atomic<int> _next;
+    int _busy;                  // Workers still on the current job
+    unsigned long _generation;  // Job counter, wakes the workers
+    bool _stop;
+};
+
+inline threadPool &getThreadPool()  // Shared pool, started on first use
+{
+    static threadPool pool(getNumThreads());
+    return pool;
+}
+
+template <typename F>
+void parallelFor(const int n, F func)
+// Calls func(i) for i = 0...n-1 spread across getNumThreads() threads
+{
+    if (n <= 0)
+        return;
+    getThreadPool().parallelFor(n, function<void(int)>(func));
+}
+
+#endif
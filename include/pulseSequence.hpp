@@ -0,0 +1,134 @@
+#ifndef PULSESEQUENCE_H
+#define PULSESEQUENCE_H
+
+#include <vector>
+#include <string>
+#include <istream>
+#include <mutex>
+#include <unordered_map>
+#include "neutron.hpp"
+#include "waveform.hpp"
+using namespace std;
+
+const int SEGMENT_PULSE = 0;   // RF pulse, integrated numerically
+const int SEGMENT_PRECESS = 1; // Free larmor precession, analytical
+const int SEGMENT_FLIP = 2;    // Instantaneous ideal rotation (e.g. spin echo pi flip), analytical
+
+struct segment {
+    int type;           // SEGMENT_PULSE, SEGMENT_PRECESS or SEGMENT_FLIP
+    double time;        // [seconds] Duration, 0 for flips
+    double wRF;         // [rad s^-1] RF strength, < 0 to derive it from tip
+    double tip;         // [rad] Pulse tip angle, or flip rotation angle
+    double axis;        // [rad] Flip rotation axis in the xy plane, 0 = x
+    bool absPhase;      // Pulse phase fixed at phase instead of locked to the RF clock
+    double phase;       // [rad] Absolute phase, or offset from the RF clock
+    bool floquet;       // Use neutron::integrateFloquet for this pulse
+    waveform rf;        // Pulse shape
+    string source;      // Config line the segment came from
+};
+
+class propagatorCache {
+// Thread safe store of pulse propagators, keyed by everything that determines
+// the pulse. Emptied when it reaches maxSize entries
+public:
+    propagatorCache(const size_t maxSize) {_maxSize = maxSize; _hits = 0; _misses = 0;}
+    bool find(const string& key, propagator& U);
+    void insert(const string& key, const propagator& U);
+    void clear();
+    size_t getSize();
+    unsigned long getHits() const {return _hits;}
+    unsigned long getMisses() const {return _misses;}
+private:
+    unordered_map<string, propagator> _cache;
+    mutex _lock;
+    size_t _maxSize;
+    unsigned long _hits, _misses;
+};
+
+class executionPlan {
+// Sequence compiled for one set of parameters. Runs of analytical segments
+// are fused into a single propagator, pulses keep their full RF parameters
+public:
+    executionPlan(const double dt) {_dt = dt;}
+    // source identifies the pulse, e.g. the config line, for propagatorCache keys.
+    // Only reusable pulses (ones a scan does not change) are stored in the cache
+    void addPulse(const double time, const vector<double>& params, const waveform& rf, const bool floquet,
+        const string& source = "", const bool reusable = false);
+    void addPropagator(const propagator& U);  // Fused into the previous step if it is analytical
+    // With a cache, reusable pulses are applied as propagators shared between plans
+    vector<double> execute(const vector<double>& ket, propagatorCache* cache = nullptr) const;
+    int getNumSteps() const {return _steps.size();}
+private:
+    struct planStep {
+        bool analytical;
+        propagator U;
+        double time;
+        vector<double> params;  // {w, w0, wRF, phi, INT_ID}, as in neutron
+        waveform rf;
+        bool floquet;
+        bool reusable;
+        string key;             // propagatorCache key
+    };
+    void integrate(neutron& ucn, const planStep& step) const;
+    double _dt;
+    vector<planStep> _steps;
+};
+
+class pulseSequence {
+// Pulse sequence read from a config file, one item per line, '#' starts a comment
+//
+//   output <file>                 Output filename
+//   w <val>, w0 <val>, phi <val>  RF frequency, B0 strength [rad s^-1], RF clock phase [rad]
+//   rf linear|circular            Type of RF
+//   rk_step <val>                 [seconds] Runge Kutta step
+//   ket <Re(a)> <Im(a)> <Re(b)> <Im(b)>   Initial state, default spin up
+//   scan <axis> <start> <end> <num>       Scan axis, see setParameter(). A second
+//                                         scan line adds the y axis of a 2D map
+//
+//   pulse <time> [wrf=|tip=] [phase=|offset=] [shape=square|sin2|gaussian] [width=] [file=]
+//         [ramp=<a0>,<a1>] [phase_ramp=<phi0>,<phi1>] [floquet]
+//   precess <time>
+//   flip [angle=pi] [axis=x|y|<rad>]
+//
+// Pulses are phase locked to the RF clock w*t + phi (t measured from the start of the
+// sequence) plus offset, unless an absolute phase= is given. Pulse durations are
+// rounded to a whole number (at least one) of rk_steps. tip= sets wRF so a pulse of that shape tips
+// the spin by tip. ramp= and phase_ramp= add linear amplitude and phase [rad] ramps
+// across the pulse (see waveform.hpp). Values accept multiples of pi, e.g. 3pi/4
+// Errors in the config throw runtime_error
+public:
+    pulseSequence();
+    pulseSequence(const string& filename);
+    void parse(istream& in, const string& source);
+    // axis is one of w, w0, phi, wrf (all pulses), tpulse (all pulse times),
+    // tprecess (all precession times)
+    void setParameter(const string& axis, const double value);
+    // Throws if setting axis to any of values gives an invalid sequence. Call before
+    // scanning in parallel, as exceptions must not escape parallelFor()
+    void checkScan(const string& axis, const vector<double>& values) const;
+    // Pulses that scanAxis can not change are marked reusable, none without a scanAxis
+    executionPlan compile(const string& scanAxis = "") const;
+    vector<double> getScanRange(const int i = 0) const;  // Scan axis i, 0 = x, 1 = y
+    string getScanAxis(const int i = 0) const;
+    int getNumScanAxes() const {return _scanAxes.size();}
+    string getOutput() const {return _output;}
+    vector<double> getKet() const {return _ket;}
+    vector<string> getFiles() const {return _files;}  // Waveform files read by file= pulses
+    string getHeader() const;   // "#W_VAL=...,W0_VAL=..." line for output files
+private:
+    int getPulseSteps(const double time, const string& where) const; // Throws if < 1
+    vector<segment> _segments;
+    double _w, _w0, _phi, _intId, _dt;
+    vector<double> _ket;
+    string _output;
+    vector<string> _files;
+    vector<string> _scanAxes;
+    vector<double> _scanStart, _scanEnd;
+    vector<int> _scanNum;
+};
+
+double parseValue(const string& str);   // Number, optionally a multiple of pi
+vector<double> parseRamp(const string& str, const string& where);  // "<start>,<end>" ramp option
+void checkParameter(const string& axis); // Throws unless axis is a valid setParameter() axis
+
+#endif
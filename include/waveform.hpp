@@ -0,0 +1,61 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <vector>
+#include <string>
+#include <complex>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <utility>
+using namespace std;
+
+// Pulse envelopes A(t), all with a peak of 1
+const int ENVELOPE_CONSTANT = 0; // Square pulse
+const int ENVELOPE_SIN2 = 1;     // sin^2 (Hann) window across the pulse
+const int ENVELOPE_GAUSSIAN = 2; // Gaussian centered on the pulse, sigma = width * pulse time
+const int ENVELOPE_FILE = 3;     // Linear interpolation of samples read from file
+
+const int PHASOR_RENORM = 1024; // Samples between exact trig evaluations of the carrier
+const size_t ENVELOPE_CACHE_SIZE = 64; // Envelope tables (pulse lengths) kept before emptying
+
+class waveform {
+// RF drive of the form wRF * A(t) * (cos, sin)(w*t + phi + dPhi(t))
+// where t is measured from the start of the pulse. A(t) is the envelope
+// (optionally times a linear amplitude ramp) and dPhi(t) is a linear phase ramp
+// plus, for ENVELOPE_FILE, a sampled phase offset. Bad input throws runtime_error
+public:
+    waveform() {_envelope = ENVELOPE_CONSTANT; _width = 0; _fileHash = 0; setAmplitudeRamp(1, 1); setPhaseRamp(0, 0);}
+    waveform(const int envelope, const double width = 0);
+    waveform(const string& filename);    // Columns time [s], amplitude[, phase [rad]]
+    void setAmplitudeRamp(const double a0, const double a1);   // A(t) *= a0 -> a1 across the pulse
+    void setPhaseRamp(const double phi0, const double phi1);   // dPhi(t) += phi0 -> phi1 across the pulse
+    bool isConstant() const;    // True for a square pulse with no ramps
+    double getAmplitude(const double t, const double time) const;  // A(t) for a pulse of length time
+    double getPhase(const double t, const double time) const;      // dPhi(t) for a pulse of length time
+    double getMeanAmplitude(const double time) const;  // Pulse area relative to a square pulse
+    string getKey() const;  // Identifies the shape, including the samples of a file
+    // Drive sampled on the RK4 half step grid t_k = k*dt/2, k = 0...2*numSteps,
+    // table[2k] = wRF*A*cos(x_k), table[2k+1] = wRF*A*sin(x_k). params as in neutron.
+    // A*exp(i*dPhi) is sampled once per (time, dt) and shared between copies,
+    // later calls only rotate the carrier
+    void getPhasorTable(const double time, const double dt, const int numSteps,
+        const vector<double>& params, vector<double>& table) const;
+private:
+    int _envelope;
+    double _width;
+    double _ampRamp[2];
+    double _phaseRamp[2];
+    vector<double> _tFile, _ampFile, _phaseFile;  // Samples for ENVELOPE_FILE
+    size_t _fileHash;                             // Of the samples, for getKey()
+    struct envelopeCache {
+        mutex lock;
+        // A*exp(i*dPhi) at t_k, keyed by (time, dt)
+        map<pair<double, double>, shared_ptr<const vector<complex<double>>>> tables;
+    };
+    shared_ptr<envelopeCache> _cache;
+    shared_ptr<const vector<complex<double>>> getEnvelopeTable(const double time, const double dt,
+        const int numSamples) const;
+};
+
+#endif
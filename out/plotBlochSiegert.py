@@ -12,12 +12,15 @@ def main():
     parser.add_argument(
         "-rf", "--ramseyFringe", type=str, nargs="+", help="rf__.txt file(s) to draw"
     )
+    parser.add_argument(
+        "-s", "--series", type=str, help="Fourier series file (USE_SPECTRAL) to draw"
+    )
     args = parser.parse_args()
 
     print(f"Loading {args.file}")
     df = pd.read_csv(
         args.file, comment="#", names=["phi", "gridSearchMin", "polyFitMin"]
-    )
+    ).sort_values("phi")
     print(df)
     bloch_siegert_params = parse_params(args.file)
     print(bloch_siegert_params)
@@ -28,7 +31,20 @@ def main():
         bloch_siegert_params["W0_VAL"] - df["polyFitMin"].to_numpy(),
         label="Polynomial fit",
         color="#005F73",
+        marker="o" if args.series else None,
+        linestyle="none" if args.series else "-",
     )
+    if args.series:
+        print(f"Loading {args.series}")
+        series = pd.read_csv(args.series, comment="#", names=["phi", "seriesMin"])
+        series_params = parse_params(args.series)
+        plt.plot(
+            series["phi"].to_numpy(),
+            series_params["W0_VAL"] - series["seriesMin"].to_numpy(),
+            label=f"Fourier series, order {int(series_params['ORDER'])}",
+            color="#EE9B00",
+        )
+        plt.legend()
     # plt.plot(
     #     df["phi"].to_numpy(),
     #     bloch_siegert_params["W0_VAL"] - df["gridSearchMin"].to_numpy(),
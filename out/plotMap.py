@@ -0,0 +1,66 @@
+#!/usr/bin/env python
+import argparse
+import matplotlib.pyplot as plt
+import numpy as np
+
+# Layout of the 128 byte header written by map2d.cpp
+HEADER = np.dtype(
+    [
+        ("magic", "S8"),
+        ("nx", "<i8"),
+        ("ny", "<i8"),
+        ("stride", "<i8"),
+        ("x0", "<f8"),
+        ("x1", "<f8"),
+        ("y0", "<f8"),
+        ("y1", "<f8"),
+        ("xAxis", "S16"),
+        ("yAxis", "S16"),
+        ("pad", "S32"),
+    ]
+)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Plots 2D zProb map from map2d.cpp")
+    parser.add_argument("-f", "--file", type=str, help="Filename", required=True)
+    args = parser.parse_args()
+
+    print(f"Loading {args.file}")
+    header, zMap = load_map(args.file)
+    if header["stride"] == 0:
+        print("No level finished yet")
+        return
+    if header["stride"] > 1:
+        print(f"Preview, map is complete to stride {header['stride']}")
+
+    plt.imshow(
+        zMap,
+        origin="lower",
+        aspect="auto",
+        extent=[header["x0"], header["x1"], header["y0"], header["y1"]],
+    )
+    plt.colorbar(label="P(z)")
+    plt.xlabel(header["xAxis"].decode())
+    plt.ylabel(header["yAxis"].decode())
+    plt.show()
+    return
+
+
+def load_map(filename):
+    # Memory mapped, so this works while map2d is still refining
+    header = np.fromfile(filename, dtype=HEADER, count=1)[0]
+    if header["magic"] != b"RAMSMAP1":
+        raise ValueError(f"{filename} is not a map2d output file")
+    zMap = np.memmap(
+        filename,
+        dtype="<f8",
+        mode="r",
+        offset=HEADER.itemsize,
+        shape=(header["ny"], header["nx"]),
+    )
+    return header, zMap
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,67 @@
+#!/usr/bin/env python
+import argparse
+import json
+import socket
+import subprocess
+
+
+class RamseyClient:
+    """Talks to a running `server` (server.cpp), either over its unix socket
+    or by starting `server` as a child process speaking on stdin/stdout"""
+
+    def __init__(self, socket_path=None, server="./server"):
+        self.next_id = 0
+        if socket_path:
+            self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self.sock.connect(socket_path)
+            self.reader = self.sock.makefile("r")
+            self.writer = self.sock.makefile("w")
+        else:
+            self.proc = subprocess.Popen(
+                [server], stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True
+            )
+            self.reader = self.proc.stdout
+            self.writer = self.proc.stdin
+
+    def request(self, **fields):
+        # Yields each response line of one request until it is done
+        self.next_id += 1
+        fields["id"] = self.next_id
+        self.writer.write(json.dumps(fields) + "\n")
+        self.writer.flush()
+        while True:
+            response = json.loads(self.reader.readline())
+            if "error" in response:
+                raise RuntimeError(response["error"])
+            yield response
+            if response.get("done") or "i" not in response:
+                return
+
+    def scan(self, **fields):
+        # Points in scan order, e.g. scan(config="config/ramsey.seq", num=11, start=183, end=184)
+        points = {}
+        for response in self.request(cmd="scan", **fields):
+            if "i" in response:
+                points[response["i"]] = response
+        return [points[i] for i in sorted(points)]
+
+    def stats(self):
+        return next(self.request(cmd="stats"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Runs a scan on the simulation server")
+    parser.add_argument("-c", "--config", type=str, help="Sequence config", required=True)
+    parser.add_argument("-s", "--socket", type=str, help="Server socket path")
+    parser.add_argument("--server", type=str, default="./server", help="server executable")
+    args = parser.parse_args()
+
+    client = RamseyClient(args.socket, args.server)
+    for point in client.scan(config=args.config):
+        print(point["value"], point["zProb"], "(cached)" if point["cached"] else "")
+    print(client.stats())
+    return
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,214 @@
+// Accuracy versus cost of every integration scheme and step size, measured
+// against exact or high precision references
+//
+// Tests:   circRabi   -- zProb after a circular RF pulse vs getCircRabiZProb
+//          precession -- xProb after free precession (RF off) vs neutron::larmorPrecess
+//          linPulse   -- zProb after a linear RF pi/2 pulse vs RK4 at REF_STEP
+//          bsMin      -- fitted minimum of a linear ramsey fringe (as in blochSiegert.cpp)
+//                        vs the same fringe made with RK4 at REF_STEP
+//
+// Outputs: benchmark.txt, with columns test, scheme, rkStep, error, seconds, pareto
+//          pareto = 1 when no other run of that test is both as accurate and as fast.
+//          The same table is printed to stdout
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+#include "neutron.hpp"
+#include "waveform.hpp"
+#include "polyfit.hpp"
+
+using namespace std;
+
+// Ramsey Fringe parameters, as in blochSiegert.cpp
+const double PRECESS_TIME = 180;  // Seconds
+const double W_STEP = 5e-7;       //[rad s^-1]    Step width of search around w0
+const int W_STEP_NUM = 20;        // Number of steps to search around w0 (both < and >= of W0_VAL)
+const double W0_VAL = 183.247172; //[rad s^-1]    Static field strength
+const double PULSE_TIME = 4.286;  //[seconds]  Time in which pi/2 pulse applied
+const double PHI_VAL = 0;         //[rad]      RF pulse inital phase
+const double DETUNING = 0.05;     //[rad s^-1] w - w0 for the single pulse tests
+
+// Integration parameters
+// Every step must divide PULSE_TIME, as integrate() overshoots otherwise
+const vector<double> RK_STEPS = {0.002, 0.001, 0.0005, 0.00025};
+const double REF_STEP = 1e-5;        // [seconds] Step for high precision references
+const double MIN_BENCH_TIME = 0.05;  // [seconds] Runs are repeated until they take this long
+
+// Output precision to stdout and file
+const int PRECISION = 6;
+
+struct scheme {
+    string name;
+    function<void(neutron &, const double, const double, const vector<double> &)> integrate;
+};
+
+struct result {
+    string test, scheme;
+    double rkStep, error, seconds;
+    bool pareto;
+};
+
+double timeRun(const function<double()> &run, double &value);
+double fringeMin(const scheme &integrator, const double dt);
+void markPareto(vector<result> &results, const int first);
+
+int main()
+{
+    vector<scheme> schemes = {
+        {"rk4", [](neutron &ucn, const double time, const double dt, const vector<double> &params) {
+             ucn.integrate(time, dt, params);
+         }},
+        {"rk4Table", [](neutron &ucn, const double time, const double dt, const vector<double> &params) {
+             ucn.integrate(time, dt, params, waveform());
+         }},
+        {"floquet", [](neutron &ucn, const double time, const double dt, const vector<double> &params) {
+             ucn.integrateFloquet(time, dt, params);
+         }}};
+    vector<result> results;
+    ofstream outfile;
+    double value;
+
+    // Exact and reference values
+    double wc = PI / (2 * PULSE_TIME);
+    double wl = PI / PULSE_TIME;
+    vector<double> circParams = {W0_VAL + DETUNING, W0_VAL, wc, PHI_VAL, USE_CIRCULAR_RF};
+    vector<double> linParams = {W0_VAL + DETUNING, W0_VAL, wl, PHI_VAL, USE_LINEAR_RF};
+    vector<double> freeParams = {W0_VAL, W0_VAL, 0, PHI_VAL, USE_LINEAR_RF};
+    vector<double> xKet = {1 / sqrt(2), 0, 1 / sqrt(2), 0};
+
+    cout << "Computing references..." << flush;
+    double circRef = getCircRabiZProb(W0_VAL + DETUNING, W0_VAL, wc, PULSE_TIME);
+    neutron freeRef(xKet);
+    freeRef.larmorPrecess(PRECESS_TIME, W0_VAL);
+    double precessRef = getXProb(freeRef.getState());
+    neutron linRef;
+    linRef.integrate(PULSE_TIME, REF_STEP, linParams);
+    double linRefZ = getZProb(linRef.getState());
+    double bsRef = fringeMin(schemes[0], REF_STEP);
+    cout << "Done\n"
+         << "Reference Bloch Siegert shift: " << setprecision(12) << W0_VAL - bsRef << " rad/s\n\n";
+
+    for (string test : {"circRabi", "precession", "linPulse", "bsMin"})
+    {
+        int first = results.size();
+        for (auto &integrator : schemes)
+        {
+            for (auto dt : RK_STEPS)
+            {
+                result res = {test, integrator.name, dt, 0, 0, false};
+                if (test == "circRabi")
+                {
+                    res.seconds = timeRun([&]() {
+                        neutron ucn;
+                        integrator.integrate(ucn, PULSE_TIME, dt, circParams);
+                        return getZProb(ucn.getState());
+                    }, value);
+                    res.error = fabs(value - circRef);
+                }
+                else if (test == "precession")
+                {
+                    res.seconds = timeRun([&]() {
+                        neutron ucn(xKet);
+                        integrator.integrate(ucn, PRECESS_TIME, dt, freeParams);
+                        return getXProb(ucn.getState());
+                    }, value);
+                    res.error = fabs(value - precessRef);
+                }
+                else if (test == "linPulse")
+                {
+                    res.seconds = timeRun([&]() {
+                        neutron ucn;
+                        integrator.integrate(ucn, PULSE_TIME, dt, linParams);
+                        return getZProb(ucn.getState());
+                    }, value);
+                    res.error = fabs(value - linRefZ);
+                }
+                else
+                {
+                    res.seconds = timeRun([&]() { return fringeMin(integrator, dt); }, value);
+                    res.error = fabs(value - bsRef);
+                }
+                results.push_back(res);
+            }
+        }
+        markPareto(results, first);
+    }
+
+    // Output
+    outfile.open("benchmark.txt");
+    outfile << "#W0_VAL=" << W0_VAL << ",PRECESS_TIME=" << PRECESS_TIME
+            << ",PULSE_TIME=" << PULSE_TIME << ",REF_STEP=" << REF_STEP << "\n";
+    outfile.precision(PRECISION);
+    outfile << "#test,scheme,rkStep,error,seconds,pareto\n";
+    cout << setprecision(PRECISION) << left << setw(12) << "test" << setw(10) << "scheme"
+         << setw(10) << "rkStep" << setw(14) << "error" << setw(14) << "seconds" << "pareto\n";
+    for (auto &res : results)
+    {
+        outfile << res.test << "," << res.scheme << "," << res.rkStep << ","
+                << res.error << "," << res.seconds << "," << res.pareto << "\n";
+        cout << setw(12) << res.test << setw(10) << res.scheme << setw(10) << res.rkStep
+             << setw(14) << res.error << setw(14) << res.seconds << (res.pareto ? "*" : "") << "\n";
+    }
+    outfile.close();
+    cout << "\nSaved to benchmark.txt\n";
+
+    return 0;
+}
+
+double timeRun(const function<double()> &run, double &value)
+// Average wall time of run(), whose result is stored in value
+{
+    int numRuns = 0;
+    auto start = chrono::steady_clock::now();
+    double elapsed;
+    do
+    {
+        value = run();
+        numRuns++;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (elapsed < MIN_BENCH_TIME);
+    return elapsed / numRuns;
+}
+
+double fringeMin(const scheme &integrator, const double dt)
+// Linear ramsey fringe around W0_VAL, minimum from a quadratic fit (x = -b/2a)
+{
+    vector<double> fringe, wRangeAdj, polyCoeff;
+    double wl = PI / PULSE_TIME;
+    for (int i = 0; i < W_STEP_NUM * 2; i++)
+    {
+        double wAdj = -(double)W_STEP_NUM * W_STEP + (double)i * W_STEP;
+        double wVal = W0_VAL + wAdj;
+        double phiVal2 = wVal * PULSE_TIME + PHI_VAL + wVal * PRECESS_TIME;
+        neutron ucn;
+        integrator.integrate(ucn, PULSE_TIME, dt, {wVal, W0_VAL, wl, PHI_VAL, USE_LINEAR_RF});
+        ucn.larmorPrecess(PRECESS_TIME, W0_VAL);
+        integrator.integrate(ucn, PULSE_TIME, dt, {wVal, W0_VAL, wl, phiVal2, USE_LINEAR_RF});
+        fringe.push_back(getZProb(ucn.getState()));
+        wRangeAdj.push_back(wAdj);
+    }
+    polyCoeff = polyfit(wRangeAdj, fringe, 2);
+    return -polyCoeff[1] / (2 * polyCoeff[2]) + W0_VAL;
+}
+
+void markPareto(vector<result> &results, const int first)
+// Among results[first...], flag runs that no other run beats on both error and time
+{
+    for (int i = first; i < results.size(); i++)
+    {
+        results[i].pareto = true;
+        for (int j = first; j < results.size(); j++)
+        {
+            bool noWorse = results[j].error <= results[i].error && results[j].seconds <= results[i].seconds;
+            bool better = results[j].error < results[i].error || results[j].seconds < results[i].seconds;
+            if (j != i && noWorse && better)
+                results[i].pareto = false;
+        }
+    }
+}
@@ -7,6 +7,23 @@
 // Fits a quadratic polynomial to the bottom of the fringe. The central peak of
 // ramsey fringe has width 1/T, where T = precession period
 //
+// Pulses are shaped by ENVELOPE (see waveform.hpp), with the RF strength rescaled
+// so the pulse area matches that of a square pi/2 pulse
+//
+// With USE_CONTINUATION the search window of each fringe is centered on the minimum
+// extrapolated from the previous fringes (see continuation.hpp), and shrinks to
+// CONT_STEP_NUM steps either side of it. Windows are widened when the fit is poor,
+// and a good fit in a window wider than CONT_REFIT_WIDTH is refit in windows
+// narrowed by CONT_ZOOM around its minimum, as the quadratic is biased when wide
+//
+// The shift is periodic in phi, so with USE_SPECTRAL fringes are only made at a few
+// phases (SPECTRAL_PHASES, or SPECTRAL_INIT_NUM evenly spaced) and a truncated Fourier
+// series is fitted to them (see fourierfit.hpp). The series is then checked against
+// fringes made at the midpoints between the fitted phases; while the largest residual
+// is above SPECTRAL_TOL those phases are added to the fit and the check repeated.
+// The series written is the last one checked, so it does not include the phases
+// of its own check. Each fringe's window is centered on the current series
+//
 // Outputs: blochSiegert.txt, with columns phi (rad), wRange (ramsey fringe freqs)
 //          gridMin(minimums on ramsey fringe from grid search),
 //          polyMin (minimums on ramsey fringe from fitting curve to polynomial),
@@ -14,14 +31,23 @@
 //
 //          Separately outputs every ramsey fringe made, numbered
 //          rf1, rf2.... etc
+//
+//          With USE_SPECTRAL, blochSiegert.txt only has the phases fringes were made at,
+//          and blochSiegertSeries.txt has columns phi, seriesMin (the series on the
+//          PHASE_STEP grid). Its header adds ORDER, FIT_PHASES (number of phases in
+//          the fit) and RESIDUAL (of this series at the held out phases)
 
 #include <iostream>
 #include <fstream>
 #include <cmath>
 #include <vector>
 #include <string>
+#include <algorithm>
 #include "neutron.hpp"
+#include "waveform.hpp"
 #include "polyfit.hpp"
+#include "continuation.hpp"
+#include "fourierfit.hpp"
 
 using namespace std;
 
@@ -35,6 +61,25 @@ const double W_STEP = 5e-7;       //[rad s^-1]    Step width of search around w0
 const int W_STEP_NUM = 100;       // Number of steps to search around w0 (both < and >= of W0_VAL)
 const double W0_VAL = 183.247172; //[rad s^-1]    Static field strength
 const double PULSE_TIME = 4.286;  //[seconds]  Time in which pi/2 pulse applied
+const int ENVELOPE = ENVELOPE_CONSTANT; // Pulse shape, see waveform.hpp
+const double ENVELOPE_WIDTH = 0.2;      // Gaussian sigma as a fraction of PULSE_TIME
+
+// Continuation parameters
+const bool USE_CONTINUATION = true; // Predict each fringe's window from the previous minima
+const int CONT_STEP_NUM = 10;       // Number of steps either side of the predicted minimum
+const double CONT_MIN_WIDTH = 1e-6; //[rad s^-1]    Smallest search half width
+const double CONT_MAX_WIDTH = 5e-3; //[rad s^-1]    Largest search half width, within the central fringe
+const double CONT_FIT_TOL = 0.01;   // Max rms fit residual, relative to the fringe's range
+const double CONT_REFIT_WIDTH = W_STEP_NUM * W_STEP; //[rad s^-1]    Widest half width a minimum is taken from
+const double CONT_ZOOM = 8;         // Half width reduction per refit
+
+// Spectral (Fourier series in phi) parameters
+const bool USE_SPECTRAL = false;         // Reconstruct the shift from a few phases instead of scanning phi
+const vector<double> SPECTRAL_PHASES = {}; //[rad] Initial phases in [0, 2pi), empty = evenly spaced
+const int SPECTRAL_INIT_NUM = 8;         // Number of evenly spaced initial phases
+const int SPECTRAL_MAX_ORDER = 8;        // Highest harmonic of phi in the series
+const double SPECTRAL_TOL = 1e-9;        //[rad s^-1]    Max residual at the held out phases
+const double SPECTRAL_SAFETY = 4;        // Search half width as a multiple of the last residual
 
 // Integration parameters
 const double INT_ID = USE_LINEAR_RF; // Type of RF pulse (USE_CIRCULAR_RF or USE_LINEAR_RF)
@@ -44,16 +89,25 @@ const double RK_STEP = 0.001;        // [seconds] For Runge Kutta integrator
 // Output precision to stdout and file
 const int PRECISION = 12;
 
+struct fringeResult {
+    vector<double> wRange, fringe;
+    double gridMin, polyMin;
+};
+
+fringeResult makeFringe(const double phi, continuation &cont, const double wl, const waveform &rf);
+void saveFringe(const int number, const double phi, const fringeResult &res);
+
 int main()
 {
-    vector<double> fringe, phaseRange, wRange, polyCoeff;
-    vector<double> wRangeAdj; // Used for polynomial fitting
-    vector<double> gridSearchMin, polyFitMin;
-    vector<double>::iterator min;
-    string filename, branchname;
+    vector<double> phaseRange;
+    vector<double> fitPhases, gridSearchMin, polyFitMin;
+    vector<double> seriesCoeff, seriesMin;
+    string filename, seriesHeader;
     ofstream outfile;
-    neutron ucn;
-    double phiVal2, wl;
+    waveform rf(ENVELOPE, ENVELOPE_WIDTH);
+    continuation cont(W0_VAL, W_STEP_NUM * W_STEP, CONT_MIN_WIDTH, CONT_MAX_WIDTH);
+    fringeResult res;
+    double wl, residual = NAN;
 
     // Vvectors of parameters to scan, calculate optimal ramsey pulse time
     wl = PI / PULSE_TIME;
@@ -64,106 +118,259 @@ int main()
         temp += PHASE_STEP;
         phaseRange.push_back(temp);
     }
-    for (int i = 0; i < W_STEP_NUM * 2; i++)
-    {
-        wRange.push_back(W0_VAL - (double)W_STEP_NUM * W_STEP + (double)i * W_STEP);
-        wRangeAdj.push_back(-(double)W_STEP_NUM * W_STEP + (double)i * W_STEP);
-    }
-
-    // For progress tracking
-    int phaseProgress = phaseRange.size();
-    int wProgress = wRange.size();
 
     // For file output
     if (INT_ID == USE_LINEAR_RF)
     {
-        filename = "linBlochSiegert.txt";
+        filename = "linBlochSiegert";
     }
     else
     {
-        filename = "circBlochSiegert.txt";
+        filename = "circBlochSiegert";
         wl = (2 * PI) / PULSE_TIME;
     }
+    wl /= rf.getMeanAmplitude(PULSE_TIME);
 
-    // Make a ramsey fringe for each value in phaseRange
     int counterPhi = 1;
-    int counterW = 0;
-    double progress;
-    for (auto phi : phaseRange)
+    if (!USE_SPECTRAL)
+    {
+        // Make a ramsey fringe for each value in phaseRange
+        for (auto phi : phaseRange)
+        {
+            // update progress
+            cout << "Fringe " << counterPhi << " / " << phaseRange.size() << endl;
+
+            res = makeFringe(phi, cont, wl, rf);
+            cont.addMinimum(phi, res.polyMin);
+            fitPhases.push_back(phi);
+            gridSearchMin.push_back(res.gridMin);
+            polyFitMin.push_back(res.polyMin);
+            saveFringe(counterPhi, phi, res);
+            counterPhi++;
+        }
+    }
+    else
+    {
+        vector<double> newPhases = SPECTRAL_PHASES;
+        if (newPhases.empty())
+        {
+            for (int i = 0; i < SPECTRAL_INIT_NUM; i++)
+                newPhases.push_back(2 * PI * i / SPECTRAL_INIT_NUM);
+        }
+        double halfWidth = W_STEP_NUM * W_STEP;
+        bool converged = false;
+        int numFitPhases = 0;
+        while (true)
+        {
+            // Fringes at the new phases, centered on the series fitted so far
+            vector<double> newMin;
+            vector<double> predicted(newPhases.size(), W0_VAL);
+            if (!seriesCoeff.empty())
+                predicted = fourierVal(seriesCoeff, newPhases);
+            for (int i = 0; i < newPhases.size(); i++)
+            {
+                cout << "Fringe " << counterPhi << ", phi = " << newPhases[i] << endl;
+                continuation window(predicted[i], halfWidth, CONT_MIN_WIDTH, CONT_MAX_WIDTH);
+                res = makeFringe(newPhases[i], window, wl, rf);
+                newMin.push_back(res.polyMin);
+                gridSearchMin.push_back(res.gridMin);
+                saveFringe(counterPhi, newPhases[i], res);
+                counterPhi++;
+            }
+
+            // Held out check of the series fitted so far
+            bool checked = !seriesCoeff.empty();
+            if (checked)
+            {
+                residual = 0;
+                for (int i = 0; i < newPhases.size(); i++)
+                    residual = max(residual, fabs(newMin[i] - predicted[i]));
+                converged = residual < SPECTRAL_TOL;
+                halfWidth = min(max(SPECTRAL_SAFETY * residual, CONT_MIN_WIDTH), CONT_MAX_WIDTH);
+                cout.precision(PRECISION);
+                cout << "Series with " << numFitPhases << " phases, order "
+                     << (seriesCoeff.size() - 1) / 2 << ": held out residual " << residual
+                     << " rad/s" << endl;
+            }
+            fitPhases.insert(fitPhases.end(), newPhases.begin(), newPhases.end());
+            polyFitMin.insert(polyFitMin.end(), newMin.begin(), newMin.end());
+
+            // Stop before refitting, so the series written is the one that was checked
+            if (checked && (converged || fitPhases.size() >= phaseRange.size()))
+                break;
+
+            // Refit with every phase so far, as many harmonics as the phases allow
+            int order = min(SPECTRAL_MAX_ORDER, ((int)fitPhases.size() - 1) / 2);
+            seriesCoeff = fourierFit(fitPhases, polyFitMin, order);
+            numFitPhases = fitPhases.size();
+
+            // Next held out phases: midpoints of the gaps, including the one across 2pi
+            vector<double> sorted = fitPhases;
+            sort(sorted.begin(), sorted.end());
+            sorted.push_back(sorted.front() + 2 * PI);
+            newPhases.clear();
+            for (int i = 0; i + 1 < sorted.size(); i++)
+                newPhases.push_back(fmod((sorted[i] + sorted[i + 1]) / 2, 2 * PI));
+        }
+        if (!converged)
+            cout << "Series did not converge to SPECTRAL_TOL" << endl;
+        seriesMin = fourierVal(seriesCoeff, phaseRange);
+        seriesHeader = ",ORDER=" + to_string((seriesCoeff.size() - 1) / 2) +
+                       ",FIT_PHASES=" + to_string(numFitPhases);
+    }
+
+    cout << "\nSaving output to " << filename << ".txt...";
+
+    outfile.open(filename + ".txt");
+    outfile.precision(PRECISION);
+    outfile << "#W0_VAL=" << W0_VAL << ",PRECESS_TIME=" << PRECESS_TIME
+            << ",PULSE_TIME=" << PULSE_TIME << ",INT_ID=" << INT_ID
+            << ",ENVELOPE=" << ENVELOPE << "\n";
+    outfile << "#phi,gridMin,polyMin\n";
+
+    for (int i = 0; i < fitPhases.size(); i++)
+    {
+        outfile << fitPhases[i] << "," << gridSearchMin[i] << ','
+                << polyFitMin[i] << "\n";
+    }
+    outfile.close();
+
+    if (USE_SPECTRAL)
     {
-        fringe.clear();
+        cout << "Done!\nSaving series to " << filename << "Series.txt...";
 
-        // update progress
-        cout << "Fringe " << counterPhi << " / " << phaseRange.size() << endl;
+        outfile.open(filename + "Series.txt");
+        outfile.precision(PRECISION);
+        outfile << "#W0_VAL=" << W0_VAL << ",PRECESS_TIME=" << PRECESS_TIME
+                << ",PULSE_TIME=" << PULSE_TIME << ",INT_ID=" << INT_ID
+                << ",ENVELOPE=" << ENVELOPE << seriesHeader << ",RESIDUAL=" << residual << "\n";
+        outfile << "#phi,seriesMin\n";
+
+        for (int i = 0; i < phaseRange.size(); i++)
+        {
+            outfile << phaseRange[i] << "," << seriesMin[i] << "\n";
+        }
+        outfile.close();
+    }
+
+    cout << "Done!\n";
+
+    return 0;
+}
+
+fringeResult makeFringe(const double phi, continuation &cont, const double wl, const waveform &rf)
+// Ramsey fringe at initial phase phi, redone in a wider window while the fit is poor
+// and in narrower ones while a good fit is wider than CONT_REFIT_WIDTH
+{
+    fringeResult res, good;
+    vector<double> wRangeAdj, polyCoeff, goodCoeff; // wRangeAdj used for polynomial fitting
+    vector<double>::iterator min;
+    neutron ucn;
+    double phiVal2, wCenter, halfWidth, goodCenter;
+    int stepNum = USE_CONTINUATION ? CONT_STEP_NUM : W_STEP_NUM;
+    double progress;
+    int counterW;
+    bool searching = true;
+    bool zooming = false;
+
+    while (searching)
+    {
+        if (!zooming)
+        {
+            // Search window around the predicted minimum
+            wCenter = USE_CONTINUATION ? cont.getCenter(phi) : W0_VAL;
+            halfWidth = USE_CONTINUATION ? cont.getHalfWidth() : W_STEP_NUM * W_STEP;
+        }
+        res.wRange.clear();
+        wRangeAdj.clear();
+        for (int i = 0; i < stepNum * 2; i++)
+        {
+            double wAdj = halfWidth * ((double)i / stepNum - 1);
+            res.wRange.push_back(wCenter + wAdj);
+            wRangeAdj.push_back(wAdj);
+        }
+        res.fringe.clear();
         cout << "0%..." << flush;
         progress = 0.1;
         counterW = 0;
 
-        for (auto wVal : wRange)
+        for (auto wVal : res.wRange)
         {
             ucn.setState({1, 0, 0, 0});
             phiVal2 = wVal * PULSE_TIME + phi + wVal * PRECESS_TIME;
-            ucn.integrate(PULSE_TIME, RK_STEP, {wVal, W0_VAL, wl, phi, INT_ID});
+            ucn.integrate(PULSE_TIME, RK_STEP, {wVal, W0_VAL, wl, phi, INT_ID}, rf);
             ucn.larmorPrecess(PRECESS_TIME, W0_VAL);
-            ucn.integrate(PULSE_TIME, RK_STEP, {wVal, W0_VAL, wl, phiVal2, INT_ID});
-            fringe.push_back(getZProb(ucn.getState()));
+            ucn.integrate(PULSE_TIME, RK_STEP, {wVal, W0_VAL, wl, phiVal2, INT_ID}, rf);
+            res.fringe.push_back(getZProb(ucn.getState()));
 
-            // Output progress
             // Print progress
-            if ((double)counterW / (double)wRange.size() >= progress)
+            if ((double)counterW / (double)res.wRange.size() >= progress)
             {
                 cout << progress * 100 << "%..." << flush;
                 progress += 0.1;
             }
             counterW++;
         }
-        // Find minimum value in fringe via grid search, store resonant freq
-        min = min_element(fringe.begin(), fringe.end());
-        gridSearchMin.push_back(wRange[distance(fringe.begin(), min)]);
 
         // Find minimum value of freq via quadratic polynomial fit
-        // Min of a quadratic function is x = -b/2a
-        polyCoeff = polyfit(wRangeAdj, fringe, 2);
-        polyFitMin.push_back(-polyCoeff[1] / (2 * polyCoeff[2]) + W0_VAL);
+        polyCoeff = polyfit(wRangeAdj, res.fringe, 2);
 
-        // Save output to file
-        branchname = "rf" + to_string(counterPhi) + ".txt";
-        outfile.open(branchname);
-        outfile.precision(PRECISION);
-        outfile << "#phi=" << phi << "\n"
-                << "#w,zProb\n";
-        for (int i = 0; i < wRange.size(); i++)
+        if (!USE_CONTINUATION)
+            searching = false;
+        else if (!isGoodFit(wRangeAdj, res.fringe, polyCoeff, CONT_FIT_TOL))
         {
-            outfile << wRange[i] << "," << fringe[i] << "\n";
+            if (zooming)
+            {
+                // Keep the last good (wider) fit
+                cout << "poor fit after zooming in, keeping wider window" << endl;
+                res = good;
+                polyCoeff = goodCoeff;
+                wCenter = goodCenter;
+                searching = false;
+            }
+            else
+            {
+                // Poor fit, e.g. the minimum walked out of the window: widen and redo
+                searching = cont.widen();
+                if (searching)
+                    cout << "poor fit, widening window" << endl;
+            }
         }
-        outfile.close();
-
-        cout << "100%" << endl;
-
-        // // debugging
-        // for (auto coeff : polyCoeff) cout << coeff << "  ";
-        // cout << "\ngridSearchMin: ( " << setprecision(12) << polyFitMin.back()+W0_VAL << " , " << polyval(polyCoeff,{-polyCoeff[1]/(2*polyCoeff[2])})[0] << " )" << endl;
-        // cout << "gridSearchMin: ( " << setprecision(12) << gridSearchMin.back() << " , " << *min << " )" << endl;
-
-        counterPhi++;
+        else if (halfWidth > CONT_REFIT_WIDTH)
+        {
+            // Good but wide fit: refit a narrower window around its minimum
+            good = res;
+            goodCoeff = polyCoeff;
+            goodCenter = wCenter;
+            zooming = true;
+            wCenter += -polyCoeff[1] / (2 * polyCoeff[2]);
+            halfWidth = max(halfWidth / CONT_ZOOM, CONT_REFIT_WIDTH);
+            cout << "zooming in" << endl;
+        }
+        else
+            searching = false;
     }
+    cout << "100%" << endl;
 
-    cout << "\nSaving output to " << filename << "...";
+    // Find minimum value in fringe via grid search, store resonant freq
+    min = min_element(res.fringe.begin(), res.fringe.end());
+    res.gridMin = res.wRange[distance(res.fringe.begin(), min)];
 
-    outfile.open(filename);
-    outfile << "#W0_VAL=" << W0_VAL << ",PRECESS_TIME=" << PRECESS_TIME
-            << ",PULSE_TIME=" << PULSE_TIME << ",INT_ID=" << INT_ID << "\n";
-    outfile.precision(PRECISION);
-    outfile << "#phi,gridMin,polyMin\n";
+    // Min of a quadratic function is x = -b/2a
+    res.polyMin = -polyCoeff[1] / (2 * polyCoeff[2]) + wCenter;
+    return res;
+}
 
-    for (int i = 0; i < phaseRange.size(); i++)
+void saveFringe(const int number, const double phi, const fringeResult &res)
+// Save output to file rf<number>.txt
+{
+    ofstream outfile("rf" + to_string(number) + ".txt");
+    outfile.precision(PRECISION);
+    outfile << "#phi=" << phi << "\n"
+            << "#w,zProb\n";
+    for (int i = 0; i < res.wRange.size(); i++)
     {
-        outfile << phaseRange[i] << "," << gridSearchMin[i] << ','
-                << polyFitMin[i] << "\n";
+        outfile << res.wRange[i] << "," << res.fringe[i] << "\n";
     }
     outfile.close();
-
-    cout << "Done!\n";
-
-    return 0;
 }
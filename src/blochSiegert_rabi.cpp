@@ -6,6 +6,17 @@
 //
 // Fits a quadratic polynomial to the bottom of the fringe.
 //
+// With USE_FLOQUET each pulse is built from the propagator of a single RF period
+// (see neutron::integrateFloquet). Before scanning, the longest pulse is checked
+// against direct integration and the program aborts if they differ by > FLOQUET_TOL
+//
+// With USE_CONTINUATION the search window of each fringe is centered on the minimum
+// extrapolated from the previous fringes (see continuation.hpp), and shrinks to
+// CONT_STEP_NUM steps either side of it. Windows are widened when the fit is poor.
+// A good fit in a window wider than CONT_REFIT_WIDTH is biased by the fringe's
+// asymmetry, so the window is narrowed around its minimum by CONT_ZOOM and the
+// fringe refit until it is no wider than CONT_REFIT_WIDTH
+//
 // Outputs: blochSiegert_rabi.txt, with columns pulseWidth (s), wRange (ramsey fringe freqs)
 //          gridMin(minimums on rabi fringe from grid search),
 //          polyMin (minimums on rabi fringe from fitting curve to polynomial),
@@ -21,6 +32,7 @@
 #include <string>
 #include "neutron.hpp"
 #include "polyfit.hpp"
+#include "continuation.hpp"
 
 using namespace std;
 
@@ -35,9 +47,20 @@ const int W_STEP_NUM = 100;       // Number of steps to search around w0 (both <
 const double W0_VAL = 183.247172; //[rad s^-1]    Static field strength
 const double PHI_INIT = 0;        //[rad] Initial phase angle of RF
 
+// Continuation parameters
+const bool USE_CONTINUATION = true; // Predict each fringe's window from the previous minima
+const int CONT_STEP_NUM = 10;       // Number of steps either side of the predicted minimum
+const double CONT_MIN_WIDTH = 1e-6; //[rad s^-1]    Smallest search half width
+const double CONT_MAX_WIDTH = 1;    //[rad s^-1]    Largest search half width
+const double CONT_FIT_TOL = 0.01;   // Max rms fit residual, relative to the fringe's range
+const double CONT_REFIT_WIDTH = W_STEP_NUM * W_STEP; //[rad s^-1]    Widest half width a minimum is taken from
+const double CONT_ZOOM = 8;         // Half width reduction per refit
+
 // Integration parameters
 const double INT_ID = USE_LINEAR_RF; // Type of RF pulse (USE_CIRCULAR_RF or USE_LINEAR_RF)
 const double RK_STEP = 0.001;        // [seconds] For Runge Kutta integrator
+const bool USE_FLOQUET = true;       // Compose pulses from one-period propagators
+const double FLOQUET_TOL = 1e-7;     // Max allowed |zProb| difference to direct integration
 
 // Output precision to stdout and file
 const int PRECISION = 12;
@@ -47,11 +70,13 @@ int main()
     vector<double> fringe, tRange, wRange, polyCoeff;
     vector<double> wRangeAdj; // Used for polynomial fitting
     vector<double> gridSearchMin, polyFitMin;
+    vector<double> goodRange, goodFringe, goodCoeff; // Last good fit while zooming in
     vector<double>::iterator min;
     string filename, branchname;
     ofstream outfile;
     neutron ucn;
-    double phiVal2, wl;
+    continuation cont(W0_VAL, W_STEP_NUM * W_STEP, CONT_MIN_WIDTH, CONT_MAX_WIDTH);
+    double wl, wCenter, halfWidth, goodCenter;
 
     // Vvectors of parameters to scan, calculate optimal ramsey pulse time
     double temp = TIME_INIT;
@@ -71,6 +96,25 @@ int main()
     int phaseProgress = tRange.size();
     int wProgress = wRange.size();
 
+    // Compare floquet propagation against direct integration for the longest pulse
+    if (USE_FLOQUET)
+    {
+        double tMax = tRange.back();
+        vector<double> params = {wRange.front(), W0_VAL, ((2 - INT_ID) * PI) / tMax, PHI_INIT, INT_ID};
+        neutron direct, floquet;
+        direct.integrate(tMax, RK_STEP, params);
+        floquet.integrateFloquet(tMax, RK_STEP, params);
+        double diff = fabs(getZProb(direct.getState()) - getZProb(floquet.getState()));
+        cout.precision(PRECISION);
+        cout << "Floquet vs direct integration, zProb difference: " << diff << endl;
+        if (diff > FLOQUET_TOL)
+        {
+            cout << "Difference exceeds FLOQUET_TOL=" << FLOQUET_TOL
+                 << ", set USE_FLOQUET = false or decrease RK_STEP" << endl;
+            exit(-1);
+        }
+    }
+
     // For file output
     if (INT_ID == USE_LINEAR_RF)
     {
@@ -85,41 +129,105 @@ int main()
     int counterTime = 1;
     int counterW = 0;
     double progress;
+    bool searching, zooming;
+    int stepNum = USE_CONTINUATION ? CONT_STEP_NUM : W_STEP_NUM;
     for (auto t : tRange)
     {
         wl = ((2 - INT_ID) * PI) / t;
-        fringe.clear();
 
         // update progress
         cout << "Fringe " << counterTime << " / " << tRange.size() << endl;
-        cout << "0%..." << flush;
-        progress = 0.1;
-        counterW = 0;
 
-        for (auto wVal : wRange)
+        searching = true;
+        zooming = false;
+        while (searching)
         {
-            ucn.setState({1, 0, 0, 0});
-            phiVal2 = wVal * t + PHI_INIT + wVal;
-            ucn.integrate(t, RK_STEP, {wVal, W0_VAL, wl, PHI_INIT, INT_ID});
-            fringe.push_back(getZProb(ucn.getState()));
-
-            // Output progress
-            // Print progress
-            if ((double)counterW / (double)wRange.size() >= progress)
+            if (!zooming)
             {
-                cout << progress * 100 << "%..." << flush;
-                progress += 0.1;
+                // Search window around the predicted minimum
+                wCenter = USE_CONTINUATION ? cont.getCenter(t) : W0_VAL;
+                halfWidth = USE_CONTINUATION ? cont.getHalfWidth() : W_STEP_NUM * W_STEP;
             }
-            counterW++;
+            wRange.clear();
+            wRangeAdj.clear();
+            for (int i = 0; i < stepNum * 2; i++)
+            {
+                double wAdj = halfWidth * ((double)i / stepNum - 1);
+                wRange.push_back(wCenter + wAdj);
+                wRangeAdj.push_back(wAdj);
+            }
+            fringe.clear();
+            cout << "0%..." << flush;
+            progress = 0.1;
+            counterW = 0;
+
+            for (auto wVal : wRange)
+            {
+                ucn.setState({1, 0, 0, 0});
+                if (USE_FLOQUET)
+                    ucn.integrateFloquet(t, RK_STEP, {wVal, W0_VAL, wl, PHI_INIT, INT_ID});
+                else
+                    ucn.integrate(t, RK_STEP, {wVal, W0_VAL, wl, PHI_INIT, INT_ID});
+                fringe.push_back(getZProb(ucn.getState()));
+
+                // Output progress
+                // Print progress
+                if ((double)counterW / (double)wRange.size() >= progress)
+                {
+                    cout << progress * 100 << "%..." << flush;
+                    progress += 0.1;
+                }
+                counterW++;
+            }
+
+            // Find minimum value of freq via quadratic polynomial fit
+            polyCoeff = polyfit(wRangeAdj, fringe, 2);
+
+            if (!USE_CONTINUATION)
+                searching = false;
+            else if (!isGoodFit(wRangeAdj, fringe, polyCoeff, CONT_FIT_TOL))
+            {
+                if (zooming)
+                {
+                    // Keep the last good (wider) fit
+                    cout << "poor fit after zooming in, keeping wider window" << endl;
+                    wRange = goodRange;
+                    fringe = goodFringe;
+                    polyCoeff = goodCoeff;
+                    wCenter = goodCenter;
+                    searching = false;
+                }
+                else
+                {
+                    // Poor fit, e.g. the minimum walked out of the window: widen and redo
+                    searching = cont.widen();
+                    if (searching)
+                        cout << "poor fit, widening window" << endl;
+                }
+            }
+            else if (halfWidth > CONT_REFIT_WIDTH)
+            {
+                // Good but wide fit: refit a narrower window around its minimum
+                goodRange = wRange;
+                goodFringe = fringe;
+                goodCoeff = polyCoeff;
+                goodCenter = wCenter;
+                zooming = true;
+                wCenter += -polyCoeff[1] / (2 * polyCoeff[2]);
+                halfWidth = max(halfWidth / CONT_ZOOM, CONT_REFIT_WIDTH);
+                cout << "zooming in" << endl;
+            }
+            else
+                searching = false;
         }
+
         // Find minimum value in fringe via grid search, store resonant freq
         min = min_element(fringe.begin(), fringe.end());
         gridSearchMin.push_back(wRange[distance(fringe.begin(), min)]);
 
-        // Find minimum value of freq via quadratic polynomial fit
         // Min of a quadratic function is x = -b/2a
-        polyCoeff = polyfit(wRangeAdj, fringe, 2);
-        polyFitMin.push_back(-polyCoeff[1] / (2 * polyCoeff[2]) + W0_VAL);
+        polyFitMin.push_back(-polyCoeff[1] / (2 * polyCoeff[2]) + wCenter);
+        cont.addMinimum(t, polyFitMin.back());
 
         // Save output to file
         branchname = "rf" + to_string(counterTime) + ".txt";
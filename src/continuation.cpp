@@ -0,0 +1,80 @@
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "continuation.hpp"
+#include "polyfit.hpp"
+
+using namespace std;
+
+const double CONT_SAFETY = 4;   // Half width as a multiple of the last prediction error
+const double CONT_EDGE = 0.8;   // Fraction of the window the fitted minimum must lie in
+
+continuation::continuation(const double wGuess, const double halfWidth, const double minHalfWidth,
+                           const double maxHalfWidth)
+{
+    _guess = wGuess;
+    _halfWidth = halfWidth;
+    _minHalfWidth = minHalfWidth;
+    _maxHalfWidth = maxHalfWidth;
+}
+
+double continuation::getCenter(const double x) const
+// Lagrange extrapolation through the last (up to) three minima
+{
+    int n = min((int)_x.size(), 3);
+    if (n == 0)
+        return _guess;
+    double center = 0;
+    for (int i = _x.size() - n; i < _x.size(); i++)
+    {
+        double weight = 1;
+        for (int j = _x.size() - n; j < _x.size(); j++)
+        {
+            if (j != i)
+                weight *= (x - _x[j]) / (_x[i] - _x[j]);
+        }
+        center += weight * _wMin[i];
+    }
+    return center;
+}
+
+bool continuation::widen()
+{
+    if (_halfWidth >= _maxHalfWidth)
+        return false;
+    _halfWidth = min(2 * _halfWidth, _maxHalfWidth);
+    return true;
+}
+
+void continuation::addMinimum(const double x, const double wMin)
+// Shrinks by at most a factor 2 per fringe, so one lucky prediction can't collapse the window
+{
+    if (!_x.empty())
+    {
+        double error = fabs(wMin - getCenter(x));
+        _halfWidth = max(CONT_SAFETY * error, _halfWidth / 2);
+        _halfWidth = min(max(_halfWidth, _minHalfWidth), _maxHalfWidth);
+    }
+    _x.push_back(x);
+    _wMin.push_back(wMin);
+}
+
+bool isGoodFit(const vector<double> &wAdj, const vector<double> &fringe,
+               const vector<double> &polyCoeff, const double tol)
+{
+    // Must be a minimum, inside the window
+    if (polyCoeff[2] <= 0)
+        return false;
+    double wMin = -polyCoeff[1] / (2 * polyCoeff[2]);
+    double center = (wAdj.front() + wAdj.back()) / 2;
+    if (fabs(wMin - center) > CONT_EDGE * (wAdj.back() - wAdj.front()) / 2)
+        return false;
+
+    // Quadratic must describe the fringe
+    vector<double> fit = polyval(polyCoeff, wAdj);
+    double sumSq = 0;
+    for (int i = 0; i < fringe.size(); i++)
+        sumSq += (fringe[i] - fit[i]) * (fringe[i] - fit[i]);
+    double range = *max_element(fringe.begin(), fringe.end()) - *min_element(fringe.begin(), fringe.end());
+    return sqrt(sumSq / fringe.size()) <= tol * range;
+}
@@ -0,0 +1,56 @@
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+#include <boost/numeric/ublas/matrix.hpp>
+#include <boost/numeric/ublas/lu.hpp>
+#include "fourierfit.hpp"
+
+using namespace std;
+
+vector<double> fourierFit(const vector<double> &x, const vector<double> &y, const int order)
+// Normal equations solved by LU decomposition, as in polyfit.hpp
+{
+    using namespace boost::numeric::ublas;
+
+    int numCoeff = 2 * order + 1;
+    if (x.size() != y.size())
+        throw invalid_argument("fourierFit: x and y sizes do not match");
+    if (x.size() < numCoeff)
+        throw invalid_argument("fourierFit: need at least 2*order + 1 points");
+
+    matrix<double> basis(x.size(), numCoeff);
+    matrix<double> yMatrix(y.size(), 1);
+    for (size_t i = 0; i < x.size(); i++)
+    {
+        basis(i, 0) = 1;
+        for (int k = 1; k <= order; k++)
+        {
+            basis(i, 2 * k - 1) = cos(k * x[i]);
+            basis(i, 2 * k) = sin(k * x[i]);
+        }
+        yMatrix(i, 0) = y[i];
+    }
+
+    matrix<double> basisT(trans(basis));
+    matrix<double> normal(prec_prod(basisT, basis));
+    matrix<double> coeff(prec_prod(basisT, yMatrix));
+    permutation_matrix<size_t> pert(normal.size1());
+    if (lu_factorize(normal, pert) != 0)
+        throw invalid_argument("fourierFit: singular fit, phases are not distinct enough");
+    lu_substitute(normal, pert, coeff);
+
+    return std::vector<double>(coeff.data().begin(), coeff.data().end());
+}
+
+vector<double> fourierVal(const vector<double> &c, const vector<double> &x)
+{
+    int order = (c.size() - 1) / 2;
+    vector<double> y(x.size());
+    for (size_t i = 0; i < x.size(); i++)
+    {
+        y[i] = c[0];
+        for (int k = 1; k <= order; k++)
+            y[i] += c[2 * k - 1] * cos(k * x[i]) + c[2 * k] * sin(k * x[i]);
+    }
+    return y;
+}
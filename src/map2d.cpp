@@ -0,0 +1,216 @@
+// Makes a 2D map of zProb over the two scan axes of a pulse sequence config
+// (see pulseSequence.hpp and /config/mapRamseyPulseWidth.seq)
+//
+// The grid is evaluated in levels, first every COARSE_STRIDE'th point in each
+// direction and then halving the stride until every point is done. After each
+// level the map file is rewritten in place, with points not yet evaluated filled
+// in from the nearest coarser point, so a full preview is available early.
+// Each level is split into tiles of up to TILE_SIZE x TILE_SIZE points, smaller on the
+// coarse levels so there are at least as many tiles as threads, shared across all cores.
+// Within a tile each row reuses one copy of the sequence
+//
+// Usage: map2d <config file>
+//
+// Outputs: the file named by "output" in the config, a binary file with a 128 byte
+//          mapHeader followed by ny*nx doubles of zProb (row major, row = y).
+//          Can be memory mapped while running, see out/plotMap.py
+//
+//          If the x axis is w, also <output>.min.txt with columns
+//          <y axis>, gridMin, polyMin (fringe minimum along each row)
+
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include "neutron.hpp"
+#include "pulseSequence.hpp"
+#include "parallel.hpp"
+#include "polyfit.hpp"
+
+using namespace std;
+
+const int COARSE_STRIDE = 16; // Grid stride of the first (preview) level
+const int TILE_SIZE = 16;     // Largest number of points per tile side
+const int FIT_HALF_WIDTH = 10; // Points either side of the grid minimum used in the fit
+
+// Output precision to stdout and file
+const int PRECISION = 12;
+
+struct mapHeader {
+    char magic[8];      // "RAMSMAP1"
+    int64_t nx, ny;
+    int64_t stride;     // Stride of the last finished level, 1 = complete, 0 = none yet
+    double x0, x1, y0, y1;
+    char xAxis[16], yAxis[16];
+    char pad[32];
+};
+static_assert(sizeof(mapHeader) == 128, "mapHeader must stay 128 bytes");
+
+void writeMap(const string &filename, mapHeader &header, const vector<double> &zMap, const int stride);
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        cout << "Usage: " << argv[0] << " <config file>" << endl;
+        return -1;
+    }
+    pulseSequence seq;
+    try
+    {
+        seq = pulseSequence(argv[1]);
+    }
+    catch (const exception &err)
+    {
+        cout << err.what() << endl;
+        return -1;
+    }
+    if (seq.getNumScanAxes() != 2)
+    {
+        cout << argv[1] << " needs two scan lines (x and y axis)" << endl;
+        return -1;
+    }
+    vector<double> xRange = seq.getScanRange(0);
+    vector<double> yRange = seq.getScanRange(1);
+    string xAxis = seq.getScanAxis(0);
+    string yAxis = seq.getScanAxis(1);
+    try
+    {
+        seq.checkScan(xAxis, xRange);
+        seq.checkScan(yAxis, yRange);
+    }
+    catch (const exception &err)
+    {
+        cout << err.what() << endl;
+        return -1;
+    }
+    int nx = xRange.size();
+    int ny = yRange.size();
+    vector<double> zMap(nx * ny, 0);
+    vector<char> evaluated(nx * ny, 0);
+
+    mapHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "RAMSMAP1", 8);
+    header.nx = nx;
+    header.ny = ny;
+    header.x0 = xRange.front();
+    header.x1 = xRange.back();
+    header.y0 = yRange.front();
+    header.y1 = yRange.back();
+    strncpy(header.xAxis, xAxis.c_str(), sizeof(header.xAxis) - 1);
+    strncpy(header.yAxis, yAxis.c_str(), sizeof(header.yAxis) - 1);
+
+    // Create the file at full size so readers can map it right away
+    {
+        ofstream outfile(seq.getOutput(), ios::binary | ios::trunc);
+    }
+    writeMap(seq.getOutput(), header, zMap, 0);
+
+    cout << "Mapping " << nx << " x " << ny << " points of (" << xAxis << ", " << yAxis
+         << ") on " << getNumThreads() << " threads" << endl;
+
+    int stride = COARSE_STRIDE;
+    while (stride > 1 && stride >= nx && stride >= ny)
+        stride /= 2;
+    int numEvaluated = 0;
+    for (; stride >= 1; stride /= 2)
+    {
+        // Halve the tiles until every thread gets at least one
+        int pointsX = (nx + stride - 1) / stride;
+        int pointsY = (ny + stride - 1) / stride;
+        int tileSide = TILE_SIZE;
+        while (tileSide > 1 && ((pointsX + tileSide - 1) / tileSide) * ((pointsY + tileSide - 1) / tileSide) < getNumThreads())
+            tileSide /= 2;
+        int tileSpan = tileSide * stride;
+        int tilesX = (nx + tileSpan - 1) / tileSpan;
+        int tilesY = (ny + tileSpan - 1) / tileSpan;
+
+        parallelFor(tilesX * tilesY, [&](int tile) {
+            int iStart = (tile % tilesX) * tileSpan;
+            int jStart = (tile / tilesX) * tileSpan;
+            for (int j = jStart; j < min(ny, jStart + tileSpan); j += stride)
+            {
+                pulseSequence row = seq;
+                row.setParameter(yAxis, yRange[j]);
+                for (int i = iStart; i < min(nx, iStart + tileSpan); i += stride)
+                {
+                    if (evaluated[j * nx + i])
+                        continue;
+                    row.setParameter(xAxis, xRange[i]);
+                    zMap[j * nx + i] = getZProb(row.compile().execute(seq.getKet()));
+                    evaluated[j * nx + i] = 1;
+                }
+            }
+        });
+
+        // Preview: fill the gaps from the grid point at the corner of each stride cell
+        numEvaluated = 0;
+        for (int j = 0; j < ny; j++)
+        {
+            for (int i = 0; i < nx; i++)
+            {
+                if (evaluated[j * nx + i])
+                    numEvaluated++;
+                else
+                    zMap[j * nx + i] = zMap[(j - j % stride) * nx + (i - i % stride)];
+            }
+        }
+        writeMap(seq.getOutput(), header, zMap, stride);
+        cout << "Stride " << stride << " done, " << numEvaluated << " / " << nx * ny
+             << " points evaluated" << endl;
+    }
+    cout << "Saved map to " << seq.getOutput() << endl;
+
+    // Fringe minimum along each row
+    if (xAxis == "w")
+    {
+        string filename = seq.getOutput() + ".min.txt";
+        ofstream outfile(filename);
+        vector<double> wAdj, fringe, polyCoeff;
+
+        cout << "Saving fringe minima to " << filename << "...";
+        outfile << seq.getHeader() << "\n";
+        outfile.precision(PRECISION);
+        outfile << "#" << yAxis << ",gridMin,polyMin\n";
+        for (int j = 0; j < ny; j++)
+        {
+            auto rowStart = zMap.begin() + j * nx;
+            int k = min_element(rowStart, rowStart + nx) - rowStart;
+
+            // Quadratic fit around the grid minimum, min of a quadratic function is x = -b/2a
+            wAdj.clear();
+            fringe.clear();
+            for (int i = max(0, k - FIT_HALF_WIDTH); i <= min(nx - 1, k + FIT_HALF_WIDTH); i++)
+            {
+                wAdj.push_back(xRange[i] - xRange[k]);
+                fringe.push_back(zMap[j * nx + i]);
+            }
+            polyCoeff = polyfit(wAdj, fringe, 2);
+            outfile << yRange[j] << "," << xRange[k] << ","
+                    << -polyCoeff[1] / (2 * polyCoeff[2]) + xRange[k] << "\n";
+        }
+        outfile.close();
+        cout << "Done!\n";
+    }
+
+    return 0;
+}
+
+void writeMap(const string &filename, mapHeader &header, const vector<double> &zMap, const int stride)
+// Overwrites the file in place, so memory mapped readers never see it shrink
+{
+    fstream outfile(filename, ios::in | ios::out | ios::binary);
+    header.stride = stride;
+    outfile.seekp(sizeof(mapHeader));
+    outfile.write((const char *)&zMap[0], zMap.size() * sizeof(double));
+    // Header last, so its stride never claims data that has not been written
+    outfile.seekp(0);
+    outfile.write((const char *)&header, sizeof(mapHeader));
+    outfile.close();
+}
@@ -2,6 +2,7 @@
 #include <cmath>
 #include <iostream>
 #include "neutron.hpp"
+#include "waveform.hpp"
 
 using namespace std;
 
@@ -61,6 +62,31 @@ void neutron::rkStep(const double t, const double dt, const vector<double> &para
         _u[i] += (dt / 6.0) * (f0[i] + 2 * f1[i] + 2 * f2[i] + f3[i]);
 }
 
+void neutron::rkStep(const double dt, const double *rf, const vector<double> &params)
+// RK4 integration step, same as above with the drive taken from a phasor table
+{
+    vector<double> f0 = derivs(_u, params[1], rf[0], rf[1], params[4]);
+    vector<double> u1(NUM_EQ);
+    vector<double> u2(NUM_EQ);
+    vector<double> u3(NUM_EQ);
+    vector<double> f1, f2, f3;
+
+    for (int i = 0; i < NUM_EQ; i++)
+        u1[i] = _u[i] + dt * f0[i] / 2.0;
+    f1 = derivs(u1, params[1], rf[2], rf[3], params[4]);
+
+    for (int i = 0; i < NUM_EQ; i++)
+        u2[i] = _u[i] + dt * f1[i] / 2.0;
+    f2 = derivs(u2, params[1], rf[2], rf[3], params[4]);
+
+    for (int i = 0; i < NUM_EQ; i++)
+        u3[i] = _u[i] + dt * f2[i];
+    f3 = derivs(u3, params[1], rf[4], rf[5], params[4]);
+
+    for (int i = 0; i < NUM_EQ; i++)
+        _u[i] += (dt / 6.0) * (f0[i] + 2 * f1[i] + 2 * f2[i] + f3[i]);
+}
+
 void neutron::integrate(const double time, const double dt, const vector<double> &params)
 {
     int t = 0;
@@ -90,26 +116,148 @@ void neutron::integrate(const double time, const double dt, const vector<double>
     }
 }
 
+void neutron::integrate(const double time, const double dt, const vector<double> &params, const waveform &rf)
+{
+    int numSteps = getStepCount(time, dt);
+    vector<double> table;
+    rf.getPhasorTable(time, dt, numSteps, params, table);
+    for (int i = 0; i < numSteps; i++)
+        rkStep(dt, &table[4 * i], params);
+}
+
+void neutron::integrateFloquet(const double time, const double dt, const vector<double> &params)
+// H(t) is periodic in T = 2pi/w, so every whole period shares a single propagator.
+// Integrates over the same n * dt that integrate() would cover. Falls back to a
+// direct propagator when w = 0 or the pulse is shorter than one period
+{
+    double totalTime = (double)getStepCount(time, dt) * dt;
+    if (params[0] == 0 || totalTime < 2 * PI / fabs(params[0]))
+    {
+        applyPropagator(getPropagator(0, totalTime, dt, params));
+        return;
+    }
+    double period = 2 * PI / fabs(params[0]);
+    unsigned long numPeriods = (unsigned long)floor(totalTime / period);
+    double remainder = totalTime - (double)numPeriods * period;
+
+    propagator U = getPropagator(0, period, dt, params).pow(numPeriods);
+    if (remainder > 0)
+        U = getPropagator((double)numPeriods * period, remainder, dt, params) * U;
+    applyPropagator(U);
+}
+
+propagator neutron::getPropagator(const double t0, const double time, const double dt, const vector<double> &params)
+// Columns of U are the evolved basis kets (a,b) = (1,0) and (0,1)
+{
+    int numSteps = (int)ceil(time / dt);
+    if (numSteps < 1)
+        return propagator();
+    double h = time / (double)numSteps;
+    neutron up({1, 0, 0, 0});
+    neutron down({0, 0, 1, 0});
+    for (int i = 0; i < numSteps; i++)
+    {
+        up.rkStep(t0 + (double)i * h, h, params);
+        down.rkStep(t0 + (double)i * h, h, params);
+    }
+    return propagator(complex<double>(up._u[0], up._u[1]), complex<double>(down._u[0], down._u[1]),
+                      complex<double>(up._u[2], up._u[3]), complex<double>(down._u[2], down._u[3]));
+}
+
 vector<double> neutron::derivs(const double t, const vector<double> &u, const vector<double> &params)
 // vector<double> params should be in the form of {w, w0, wRF, phi, INT_ID}
 // w is the driving RF frequency in rad/s
 // w0 is the strength of the applied B0 field in rad/s
 // wRF is the strength of the linear/circular RF field in rad/s
 // INT_ID is either USE_LINEAR_RF (linear RF) or USE_CIRCULAR_RF (circular RF)
-//
+{
+    double x = params[0] * t + params[3];
+    return derivs(u, params[1], params[2] * cos(x), params[2] * sin(x), params[4]);
+}
+
+vector<double> neutron::derivs(const vector<double> &u, const double w0, const double rfCos,
+                               const double rfSin, const double intId)
 // Modified right hand side of eq C.7 - C.10 in thesis
 // using eq 3.38, 3.39 as a basis
 // u[0] = Re(a), u[1] = Im(a), u[2] = Re(b), u(3) = Im(b)
 {
     vector<double> dudt(NUM_EQ);
-    double x = params[0] * t + params[3];
-    dudt[0] = 0.5 * (params[1] * u[1] + params[2] * cos(x) * u[3]) - params[4] / 2 * params[2] * u[2] * sin(x);
-    dudt[1] = 0.5 * (-params[1] * u[0] - params[2] * cos(x) * u[2]) - params[4] / 2 * params[2] * u[3] * sin(x);
-    dudt[2] = 0.5 * (-params[1] * u[3] + params[2] * cos(x) * u[1]) + params[4] / 2 * params[2] * u[0] * sin(x);
-    dudt[3] = 0.5 * (params[1] * u[2] - params[2] * cos(x) * u[0]) + params[4] / 2 * params[2] * u[1] * sin(x);
+    dudt[0] = 0.5 * (w0 * u[1] + rfCos * u[3]) - intId / 2 * rfSin * u[2];
+    dudt[1] = 0.5 * (-w0 * u[0] - rfCos * u[2]) - intId / 2 * rfSin * u[3];
+    dudt[2] = 0.5 * (-w0 * u[3] + rfCos * u[1]) + intId / 2 * rfSin * u[0];
+    dudt[3] = 0.5 * (w0 * u[2] - rfCos * u[0]) + intId / 2 * rfSin * u[1];
     return dudt;
 }
 
+propagator::propagator()
+{
+    m[0][0] = 1;
+    m[0][1] = 0;
+    m[1][0] = 0;
+    m[1][1] = 1;
+}
+
+propagator::propagator(const complex<double> u00, const complex<double> u01,
+                       const complex<double> u10, const complex<double> u11)
+{
+    m[0][0] = u00;
+    m[0][1] = u01;
+    m[1][0] = u10;
+    m[1][1] = u11;
+}
+
+propagator propagator::operator*(const propagator &rhs) const
+{
+    propagator prod;
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 2; j++)
+            prod.m[i][j] = m[i][0] * rhs.m[0][j] + m[i][1] * rhs.m[1][j];
+    return prod;
+}
+
+propagator propagator::pow(unsigned long n) const
+// Repeated squaring, O(log n) matrix products
+{
+    propagator result;
+    propagator base = *this;
+    while (n > 0)
+    {
+        if (n & 1)
+            result = base * result;
+        base = base * base;
+        n >>= 1;
+    }
+    return result;
+}
+
+vector<double> propagator::apply(const vector<double> &u) const
+{
+    complex<double> a(u[0], u[1]);
+    complex<double> b(u[2], u[3]);
+    complex<double> aEnd = m[0][0] * a + m[0][1] * b;
+    complex<double> bEnd = m[1][0] * a + m[1][1] * b;
+    return {aEnd.real(), aEnd.imag(), bEnd.real(), bEnd.imag()};
+}
+
+double getCircRabiZProb(const double w, const double w0, const double wc, const double t)
+// Analytical solution to a ramsey pulse with a neutron starting spin up
+// May thesis eq 3.51
+{
+    double omega = sqrt((w - w0) * (w - w0) + wc * wc) / 2;
+    return 1 - (wc * wc / ((w - w0) * (w - w0) + wc * wc) * sin(omega * t) * sin(omega * t));
+}
+
+int getStepCount(const double time, const double dt)
+// Matches the loop condition t * dt < time used by neutron::integrate
+{
+    int numSteps = (int)ceil(time / dt);
+    while (numSteps > 0 && (double)(numSteps - 1) * dt >= time)
+        numSteps--;
+    while ((double)numSteps * dt < time)
+        numSteps++;
+    return numSteps;
+}
+
 double getXProb(const vector<double> &u) // Odds of measuring spin up along x
 {
     if (u.size() != NUM_EQ)
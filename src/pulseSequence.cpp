@@ -0,0 +1,499 @@
+#include <vector>
+#include <string>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "neutron.hpp"
+#include "waveform.hpp"
+#include "pulseSequence.hpp"
+
+using namespace std;
+
+void executionPlan::addPulse(const double time, const vector<double> &params, const waveform &rf, const bool floquet,
+                             const string &source, const bool reusable)
+{
+    ostringstream key;
+    key.precision(17);
+    key << source << "|" << rf.getKey() << "|" << time << "," << _dt;
+    for (auto param : params)
+        key << "," << param;
+
+    planStep step;
+    step.analytical = false;
+    step.time = time;
+    step.params = params;
+    step.rf = rf;
+    step.floquet = floquet;
+    step.reusable = reusable;
+    step.key = key.str();
+    _steps.push_back(step);
+}
+
+void executionPlan::addPropagator(const propagator &U)
+{
+    if (!_steps.empty() && _steps.back().analytical)
+    {
+        _steps.back().U = U * _steps.back().U;
+        return;
+    }
+    planStep step;
+    step.analytical = true;
+    step.U = U;
+    step.time = 0;
+    step.floquet = false;
+    step.reusable = false;
+    _steps.push_back(step);
+}
+
+vector<double> executionPlan::execute(const vector<double> &ket, propagatorCache *cache) const
+{
+    neutron ucn(ket);
+    for (auto &step : _steps)
+    {
+        if (step.analytical)
+            ucn.applyPropagator(step.U);
+        else if (!cache || !step.reusable)
+            integrate(ucn, step);
+        else
+        {
+            // Pulse propagator, columns are the evolved basis kets (a,b) = (1,0) and (0,1)
+            propagator U;
+            if (!cache->find(step.key, U))
+            {
+                neutron up({1, 0, 0, 0});
+                neutron down({0, 0, 1, 0});
+                integrate(up, step);
+                integrate(down, step);
+                vector<double> a = up.getState();
+                vector<double> b = down.getState();
+                U = propagator(complex<double>(a[0], a[1]), complex<double>(b[0], b[1]),
+                               complex<double>(a[2], a[3]), complex<double>(b[2], b[3]));
+                cache->insert(step.key, U);
+            }
+            ucn.applyPropagator(U);
+        }
+    }
+    return ucn.getState();
+}
+
+void executionPlan::integrate(neutron &ucn, const planStep &step) const
+{
+    if (step.floquet)
+        ucn.integrateFloquet(step.time, _dt, step.params);
+    else
+        ucn.integrate(step.time, _dt, step.params, step.rf);
+}
+
+bool propagatorCache::find(const string &key, propagator &U)
+{
+    lock_guard<mutex> lock(_lock);
+    auto entry = _cache.find(key);
+    if (entry == _cache.end())
+    {
+        _misses++;
+        return false;
+    }
+    _hits++;
+    U = entry->second;
+    return true;
+}
+
+void propagatorCache::insert(const string &key, const propagator &U)
+{
+    lock_guard<mutex> lock(_lock);
+    if (_cache.size() >= _maxSize)
+        _cache.clear();
+    _cache[key] = U;
+}
+
+void propagatorCache::clear()
+{
+    lock_guard<mutex> lock(_lock);
+    _cache.clear();
+    _hits = 0;
+    _misses = 0;
+}
+
+size_t propagatorCache::getSize()
+{
+    lock_guard<mutex> lock(_lock);
+    return _cache.size();
+}
+
+pulseSequence::pulseSequence()
+{
+    _w = 0;
+    _w0 = 0;
+    _phi = 0;
+    _intId = USE_LINEAR_RF;
+    _dt = 0.001;
+    _ket = {1, 0, 0, 0};
+    _output = "sequence.txt";
+}
+
+pulseSequence::pulseSequence(const string &filename) : pulseSequence()
+{
+    ifstream infile(filename);
+    if (!infile)
+    {
+        throw runtime_error("pulseSequence: could not open " + filename);
+    }
+    parse(infile, filename);
+}
+
+void pulseSequence::parse(istream &in, const string &source)
+{
+    string line, key;
+    int lineNum = 0;
+    while (getline(in, line))
+    {
+        lineNum++;
+        line = line.substr(0, line.find('#'));
+        istringstream tokens(line);
+        if (!(tokens >> key))
+            continue;
+
+        string where = source + ":" + to_string(lineNum) + ": ";
+        vector<string> args;
+        string arg;
+        while (tokens >> arg)
+            args.push_back(arg);
+
+        if (key == "pulse" || key == "precess")
+        {
+            if (args.empty())
+            {
+                throw runtime_error(where + key + " needs a duration");
+            }
+            segment seg;
+            seg.type = (key == "pulse") ? SEGMENT_PULSE : SEGMENT_PRECESS;
+            seg.source = line;
+            seg.time = parseValue(args[0]);
+            seg.wRF = -1;
+            seg.tip = -1;
+            seg.axis = 0;
+            seg.absPhase = false;
+            seg.phase = 0;
+            seg.floquet = false;
+
+            int envelope = ENVELOPE_CONSTANT;
+            double width = 0;
+            string file;
+            vector<double> ampRamp = {1, 1}, phaseRamp = {0, 0};
+            for (int i = 1; i < args.size() && seg.type == SEGMENT_PULSE; i++)
+            {
+                string name = args[i].substr(0, args[i].find('='));
+                string value = (args[i].find('=') == string::npos) ? "" : args[i].substr(args[i].find('=') + 1);
+                if (name == "wrf")
+                    seg.wRF = parseValue(value);
+                else if (name == "tip")
+                    seg.tip = parseValue(value);
+                else if (name == "phase")
+                {
+                    seg.absPhase = true;
+                    seg.phase = parseValue(value);
+                }
+                else if (name == "offset")
+                    seg.phase = parseValue(value);
+                else if (name == "width")
+                    width = parseValue(value);
+                else if (name == "file")
+                    file = value;
+                else if (name == "ramp")
+                    ampRamp = parseRamp(value, where);
+                else if (name == "phase_ramp")
+                    phaseRamp = parseRamp(value, where);
+                else if (name == "floquet")
+                    seg.floquet = true;
+                else if (name == "shape" && value == "square")
+                    envelope = ENVELOPE_CONSTANT;
+                else if (name == "shape" && value == "sin2")
+                    envelope = ENVELOPE_SIN2;
+                else if (name == "shape" && value == "gaussian")
+                    envelope = ENVELOPE_GAUSSIAN;
+                else
+                {
+                    throw runtime_error(where + "unknown pulse option '" + args[i] + "'");
+                }
+            }
+            if (seg.type == SEGMENT_PRECESS && args.size() > 1)
+            {
+                throw runtime_error(where + "precess takes only a duration");
+            }
+            if (seg.type == SEGMENT_PULSE)
+            {
+                try
+                {
+                    seg.rf = file.empty() ? waveform(envelope, width) : waveform(file);
+                }
+                catch (const exception &err)
+                {
+                    throw runtime_error(where + err.what());
+                }
+                if (!file.empty())
+                    _files.push_back(file);
+                seg.rf.setAmplitudeRamp(ampRamp[0], ampRamp[1]);
+                seg.rf.setPhaseRamp(phaseRamp[0], phaseRamp[1]);
+                if ((seg.wRF < 0) == (seg.tip < 0))
+                {
+                    throw runtime_error(where + "pulse needs exactly one of wrf= or tip=");
+                }
+                if (seg.floquet && !seg.rf.isConstant())
+                {
+                    throw runtime_error(where + "floquet needs a square pulse");
+                }
+            }
+            _segments.push_back(seg);
+        }
+        else if (key == "flip")
+        {
+            segment seg;
+            seg.type = SEGMENT_FLIP;
+            seg.source = line;
+            seg.time = 0;
+            seg.wRF = 0;
+            seg.tip = PI;
+            seg.axis = 0;
+            seg.absPhase = false;
+            seg.phase = 0;
+            seg.floquet = false;
+            for (auto &opt : args)
+            {
+                string name = opt.substr(0, opt.find('='));
+                string value = (opt.find('=') == string::npos) ? "" : opt.substr(opt.find('=') + 1);
+                if (name == "angle")
+                    seg.tip = parseValue(value);
+                else if (name == "axis" && value == "x")
+                    seg.axis = 0;
+                else if (name == "axis" && value == "y")
+                    seg.axis = PI / 2;
+                else if (name == "axis")
+                    seg.axis = parseValue(value);
+                else
+                {
+                    throw runtime_error(where + "unknown flip option '" + opt + "'");
+                }
+            }
+            _segments.push_back(seg);
+        }
+        else if (key == "output" && args.size() == 1)
+            _output = args[0];
+        else if (key == "w" && args.size() == 1)
+            _w = parseValue(args[0]);
+        else if (key == "w0" && args.size() == 1)
+            _w0 = parseValue(args[0]);
+        else if (key == "phi" && args.size() == 1)
+            _phi = parseValue(args[0]);
+        else if (key == "rk_step" && args.size() == 1)
+            _dt = parseValue(args[0]);
+        else if (key == "rf" && args.size() == 1 && args[0] == "linear")
+            _intId = USE_LINEAR_RF;
+        else if (key == "rf" && args.size() == 1 && args[0] == "circular")
+            _intId = USE_CIRCULAR_RF;
+        else if (key == "ket" && args.size() == NUM_EQ)
+        {
+            for (int i = 0; i < NUM_EQ; i++)
+                _ket[i] = parseValue(args[i]);
+        }
+        else if (key == "scan" && args.size() == 4)
+        {
+            checkParameter(args[0]);
+            if (_scanAxes.size() == 2)
+            {
+                throw runtime_error(where + "at most two scan axes are allowed");
+            }
+            _scanAxes.push_back(args[0]);
+            _scanStart.push_back(parseValue(args[1]));
+            _scanEnd.push_back(parseValue(args[2]));
+            _scanNum.push_back((int)parseValue(args[3]));
+        }
+        else
+        {
+            throw runtime_error(where + "could not parse '" + line + "'");
+        }
+    }
+
+    // rk_step may come after the pulses
+    for (auto &seg : _segments)
+    {
+        if (seg.type == SEGMENT_PULSE)
+            getPulseSteps(seg.time, source + ": pulse '" + seg.source + "': ");
+    }
+}
+
+int pulseSequence::getPulseSteps(const double time, const string &where) const
+{
+    int numSteps = (int)round(time / _dt);
+    if (numSteps < 1)
+    {
+        throw runtime_error(where + "pulse time " + to_string(time) + " is shorter than half an rk_step");
+    }
+    return numSteps;
+}
+
+void checkParameter(const string &axis)
+{
+    if (axis != "w" && axis != "w0" && axis != "phi" && axis != "wrf" && axis != "tpulse" && axis != "tprecess")
+    {
+        throw runtime_error("pulseSequence: unknown parameter '" + axis +
+                            "', use w, w0, phi, wrf, tpulse or tprecess");
+    }
+}
+
+void pulseSequence::setParameter(const string &axis, const double value)
+{
+    checkParameter(axis);
+    if (axis == "w")
+        _w = value;
+    else if (axis == "w0")
+        _w0 = value;
+    else if (axis == "phi")
+        _phi = value;
+    else
+    {
+        for (auto &seg : _segments)
+        {
+            if (axis == "wrf" && seg.type == SEGMENT_PULSE)
+            {
+                seg.wRF = value;
+                seg.tip = -1;
+            }
+            else if (axis == "tpulse" && seg.type == SEGMENT_PULSE)
+            {
+                getPulseSteps(value, "pulseSequence: ");
+                seg.time = value;
+            }
+            else if (axis == "tprecess" && seg.type == SEGMENT_PRECESS)
+                seg.time = value;
+        }
+    }
+}
+
+void pulseSequence::checkScan(const string &axis, const vector<double> &values) const
+{
+    pulseSequence probe = *this;
+    for (auto value : values)
+        probe.setParameter(axis, value);
+}
+
+executionPlan pulseSequence::compile(const string &scanAxis) const
+// Walks the sequence on the global RF clock so every pulse starts in phase
+// with w*t + phi, e.g. a second ramsey pulse gets phi + w*(PULSE_1_TIME + PRECESS_TIME)
+{
+    executionPlan plan(_dt);
+    double tNow = 0;
+    bool precessed = false; // A precession came before, so tprecess moves the RF clock
+    for (auto &seg : _segments)
+    {
+        double time = seg.time;
+        if (seg.type == SEGMENT_PULSE)
+        {
+            // Snapped to the RK grid, so the clock advances by the time actually integrated
+            time = getPulseSteps(seg.time, "pulseSequence: ") * _dt;
+            double wRF = seg.wRF;
+            if (wRF < 0)
+                wRF = (2 - _intId) * seg.tip / (time * seg.rf.getMeanAmplitude(time));
+            double phase = seg.absPhase ? seg.phase : _phi + _w * tNow + seg.phase;
+            // w, w0, wrf and tpulse scans change every pulse, phi the clock locked ones
+            bool reusable = (scanAxis == "phi" && seg.absPhase) ||
+                            (scanAxis == "tprecess" && (seg.absPhase || !precessed));
+            plan.addPulse(time, {_w, _w0, wRF, phase, _intId}, seg.rf, seg.floquet, seg.source, reusable);
+        }
+        else if (seg.type == SEGMENT_PRECESS)
+        {
+            precessed = true;
+            // Same rotation as neutron::larmorPrecess
+            complex<double> x = polar(1.0, seg.time * _w0 / 2);
+            plan.addPropagator(propagator(conj(x), 0, 0, x));
+        }
+        else
+        {
+            // exp(-i angle/2 (cos(axis) sigma_x + sin(axis) sigma_y))
+            double c = cos(seg.tip / 2);
+            double s = sin(seg.tip / 2);
+            complex<double> u01 = complex<double>(0, -s) * polar(1.0, -seg.axis);
+            complex<double> u10 = complex<double>(0, -s) * polar(1.0, seg.axis);
+            plan.addPropagator(propagator(c, u01, u10, c));
+        }
+        tNow += time;
+    }
+    return plan;
+}
+
+vector<double> pulseSequence::getScanRange(const int i) const
+// Evenly spaced, including both ends. Empty if there is no scan axis i
+{
+    vector<double> range;
+    if (i >= _scanAxes.size())
+        return range;
+    for (int j = 0; j < _scanNum[i]; j++)
+    {
+        if (_scanNum[i] == 1)
+            range.push_back(_scanStart[i]);
+        else
+            range.push_back(_scanStart[i] + (double)j * (_scanEnd[i] - _scanStart[i]) / (double)(_scanNum[i] - 1));
+    }
+    return range;
+}
+
+string pulseSequence::getScanAxis(const int i) const
+{
+    return (i < _scanAxes.size()) ? _scanAxes[i] : "";
+}
+
+string pulseSequence::getHeader() const
+{
+    ostringstream header;
+    header.precision(12);
+    header << "#W_VAL=" << _w << ",W0_VAL=" << _w0 << ",PHI_VAL=" << _phi
+           << ",RK_STEP=" << _dt << ",INT_ID=" << _intId;
+    return header.str();
+}
+
+vector<double> parseRamp(const string &str, const string &where)
+// "<start>,<end>", each as in parseValue
+{
+    size_t comma = str.find(',');
+    if (comma == string::npos || str.find(',', comma + 1) != string::npos)
+    {
+        throw runtime_error(where + "ramp needs '<start>,<end>', got '" + str + "'");
+    }
+    return {parseValue(str.substr(0, comma)), parseValue(str.substr(comma + 1))};
+}
+
+double parseValue(const string &str)
+// Accepts plain numbers and multiples of pi: pi, -pi/2, 3pi/4, 2*pi
+{
+    size_t pos = str.find("pi");
+    try
+    {
+        if (pos == string::npos)
+        {
+            size_t end;
+            double value = stod(str, &end);
+            if (end == str.size())
+                return value;
+        }
+        else
+        {
+            string factor = str.substr(0, pos);
+            string divisor = str.substr(pos + 2);
+            if (!factor.empty() && factor.back() == '*')
+                factor.pop_back();
+            double value = PI;
+            if (factor == "-")
+                value = -PI;
+            else if (!factor.empty())
+                value *= stod(factor);
+            if (divisor.empty())
+                return value;
+            if (divisor[0] == '/')
+                return value / stod(divisor.substr(1));
+        }
+    }
+    catch (const exception &)
+    {
+    }
+    throw runtime_error("parseValue: could not parse '" + str + "'");
+}
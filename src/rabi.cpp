@@ -37,8 +37,6 @@ const double TIME_STEP = 0.001; // [seconds]
 // Output precision to stdout and file
 const int PRECISION = 12;
 
-double analytical(double w, double w0, double wc, double t);
-
 int main()
 {
     vector<vector<double>> t(2), x(2), y(2), z(2);
@@ -59,7 +57,7 @@ int main()
     cout << "lin: " << getZProb(lin.getState()) << endl;
     cout << "Difference between analytical and numerical sol (circular RF): ";
     cout << setprecision(PRECISION)
-         << analytical(W_VAL, W0_VAL, WC_VAL, MAX_TIME) - getZProb(circ.getState()) << endl;
+         << getCircRabiZProb(W_VAL, W0_VAL, WC_VAL, MAX_TIME) - getZProb(circ.getState()) << endl;
     cout << "Difference between numerical circ and numerical linear RF: ";
     cout << setprecision(PRECISION)
          << getZProb(lin.getState()) - getZProb(circ.getState()) << "\n\n";
@@ -85,11 +83,3 @@ int main()
 
     return 0;
 }
-
-double analytical(double w, double w0, double wc, double t)
-// Analytical solution to a ramsey pulse with a neutron starting spin up
-// May thesis eq 3.51
-{
-    double omega = sqrt((w - w0) * (w - w0) + wc * wc) / 2;
-    return 1 - (wc * wc / ((w - w0) * (w - w0) + wc * wc) * sin(omega * t) * sin(omega * t));
-}
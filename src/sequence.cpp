@@ -0,0 +1,104 @@
+// Runs a pulse sequence described in a config file (see pulseSequence.hpp and
+// the examples in /config/) over its scan axis, using every core
+//
+// Usage: sequence <config file>
+//
+// Output: the file named by "output" in the config, with columns
+//         <scan axis>, xProb, yProb, zProb
+//         Header has params {W_VAL, W0_VAL, PHI_VAL, RK_STEP, INT_ID}
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <stdexcept>
+#include "neutron.hpp"
+#include "pulseSequence.hpp"
+#include "parallel.hpp"
+
+using namespace std;
+
+// Output precision to stdout and file
+const int PRECISION = 12;
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        cout << "Usage: " << argv[0] << " <config file>" << endl;
+        return -1;
+    }
+    pulseSequence seq;
+    try
+    {
+        seq = pulseSequence(argv[1]);
+    }
+    catch (const exception &err)
+    {
+        cout << err.what() << endl;
+        return -1;
+    }
+    vector<double> scanRange = seq.getScanRange();
+    if (scanRange.empty())
+    {
+        cout << argv[1] << " has no scan line" << endl;
+        return -1;
+    }
+    if (seq.getNumScanAxes() > 1)
+    {
+        cout << argv[1] << " has two scan lines, use map2d for 2D scans" << endl;
+        return -1;
+    }
+    try
+    {
+        seq.checkScan(seq.getScanAxis(), scanRange);
+    }
+    catch (const exception &err)
+    {
+        cout << err.what() << endl;
+        return -1;
+    }
+    vector<vector<double>> states(scanRange.size());
+    ofstream outfile;
+
+    cout << "Running " << argv[1] << " over " << scanRange.size() << " values of "
+         << seq.getScanAxis() << " on " << getNumThreads() << " threads" << endl;
+    cout << "0%..." << flush;
+
+    mutex progressLock;
+    int numDone = 0;
+    double progress = 0.1;
+    parallelFor(scanRange.size(), [&](int i) {
+        pulseSequence point = seq;
+        point.setParameter(seq.getScanAxis(), scanRange[i]);
+        states[i] = point.compile().execute(seq.getKet());
+
+        // Print progress
+        lock_guard<mutex> lock(progressLock);
+        numDone++;
+        while ((double)numDone / (double)scanRange.size() >= progress && progress < 0.95)
+        {
+            cout << progress * 100 << "%..." << flush;
+            progress += 0.1;
+        }
+    });
+
+    cout << "100%" << endl
+         << "Saving output to " << seq.getOutput() << "...";
+
+    outfile.open(seq.getOutput());
+    outfile << seq.getHeader() << "\n";
+    outfile.precision(PRECISION);
+    outfile << "#" << seq.getScanAxis() << ",xProb,yProb,zProb\n";
+    for (int i = 0; i < scanRange.size(); i++)
+    {
+        outfile << scanRange[i] << "," << getXProb(states[i]) << ","
+                << getYProb(states[i]) << "," << getZProb(states[i]) << "\n";
+    }
+    outfile.close();
+
+    cout << "Done!\n";
+
+    return 0;
+}
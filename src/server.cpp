@@ -0,0 +1,507 @@
+// Long lived simulation server. Keeps the thread pool, parsed sequences, pulse
+// propagators and results warm between requests, so repeated or small queries
+// from python/plot scripts come back without recompiling or restarting anything
+//
+// Usage: server                    Requests on stdin, responses on stdout
+//        server --socket <path>    Listens on a unix socket, one client at a time
+//
+// Protocol: one JSON object per line each way (see out/ramseyClient.py)
+//
+//   {"id": 1, "cmd": "scan", "config": "config/ramsey.seq"}
+//   {"id": 2, "cmd": "scan", "sequence": "<config text>", "set": {"w0": 183.2},
+//    "axis": "w", "start": 183.2, "end": 183.3, "num": 11}    (or "values": [...])
+//   {"id": 3, "cmd": "stats"}   {"id": 4, "cmd": "clear"}   {"id": 5, "cmd": "quit"}
+//
+// A scan defaults to the config's first scan line, other axes need "values" or "num".
+// Results stream back as they finish (cached points first, in no particular order):
+//   {"id":1,"i":0,"value":183.2,"xProb":...,"yProb":...,"zProb":...,"cached":false}
+// followed by {"id":1,"done":true,...}. Failures answer {"id":1,"error":"..."}
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include "neutron.hpp"
+#include "pulseSequence.hpp"
+#include "parallel.hpp"
+
+using namespace std;
+
+const size_t MAX_RESULTS = 1000000;     // Result cache entries before it is emptied
+const size_t MAX_PROPAGATORS = 1000000; // Pulse propagator cache entries before it is emptied
+const size_t MAX_SEQUENCES = 100;       // Parsed sequences kept
+
+// Output precision of responses
+const int PRECISION = 12;
+
+struct jsonValue {
+    char type;      // 'n'umber, 's'tring, 'b'ool, 'a'rray, 'o'bject or 0 for null
+    double number;
+    string str;
+    bool boolean;
+    vector<jsonValue> array;
+    map<string, jsonValue> object;
+};
+
+jsonValue parseJson(const string &text);
+string toJson(const jsonValue &value);
+string quoteJson(const string &str);
+bool serve(FILE *in, FILE *out);
+
+struct parsedSequence {
+    pulseSequence seq;
+    string stamp;   // getFileStamp() of its waveform files when parsed
+};
+
+// Warm state shared by every request
+propagatorCache pulseCache(MAX_PROPAGATORS);
+unordered_map<string, vector<double>> resultCache;
+unordered_map<string, parsedSequence> sequenceCache;
+mutex resultLock, outputLock;
+
+int main(int argc, char *argv[])
+{
+    signal(SIGPIPE, SIG_IGN); // A client hanging up must not take the server down
+    getThreadPool();          // Start the workers now rather than on the first request
+
+    if (argc == 1)
+    {
+        serve(stdin, stdout);
+        return 0;
+    }
+    if (argc != 3 || string(argv[1]) != "--socket")
+    {
+        cout << "Usage: " << argv[0] << " [--socket <path>]" << endl;
+        return -1;
+    }
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (string(argv[2]).size() >= sizeof(addr.sun_path))
+    {
+        cout << "Socket path too long: " << argv[2] << endl;
+        return -1;
+    }
+    strcpy(addr.sun_path, argv[2]);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(argv[2]);
+    if (listener < 0 || bind(listener, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 4) < 0)
+    {
+        perror("server");
+        return -1;
+    }
+    cout << "Listening on " << argv[2] << " with " << getThreadPool().getNumThreads() << " threads" << endl;
+
+    bool quit = false;
+    while (!quit)
+    {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+            continue;
+        FILE *in = fdopen(client, "r");
+        FILE *out = fdopen(dup(client), "w");
+        quit = serve(in, out);
+        fclose(in);
+        fclose(out);
+    }
+    close(listener);
+    unlink(argv[2]);
+
+    return 0;
+}
+
+void respond(FILE *out, const string &line)
+{
+    lock_guard<mutex> lock(outputLock);
+    fputs(line.c_str(), out);
+    fputc('\n', out);
+    fflush(out);
+}
+
+string formatNumber(const double value, const int precision = PRECISION)
+{
+    ostringstream str;
+    str.precision(precision);
+    str << value;
+    return str.str();
+}
+
+double getNumber(const jsonValue &value, const string &name)
+{
+    if (value.type != 'n')
+        throw runtime_error("\"" + name + "\" must be a number");
+    return value.number;
+}
+
+string getFileStamp(const vector<string> &files)
+// Name, modification time and size of each file, changes whenever one is edited
+{
+    string stamp;
+    for (auto &file : files)
+    {
+        struct stat info;
+        if (stat(file.c_str(), &info) != 0)
+            throw runtime_error("could not open " + file);
+        stamp += file + "@" + to_string(info.st_mtim.tv_sec) + "." + to_string(info.st_mtim.tv_nsec) +
+                 ":" + to_string(info.st_size) + ";";
+    }
+    return stamp;
+}
+
+pulseSequence &getSequence(const string &text, string &stamp)
+// Parses each distinct sequence text once, and again after a waveform file it reads
+// changes. stamp is set to the files' getFileStamp(), for result keys
+{
+    auto entry = sequenceCache.find(text);
+    if (entry != sequenceCache.end())
+    {
+        stamp = getFileStamp(entry->second.seq.getFiles());
+        if (stamp == entry->second.stamp)
+            return entry->second.seq;
+    }
+    if (sequenceCache.size() >= MAX_SEQUENCES)
+        sequenceCache.clear();
+    parsedSequence parsed;
+    istringstream in(text);
+    parsed.seq.parse(in, "request");
+    parsed.stamp = stamp = getFileStamp(parsed.seq.getFiles());
+    return (sequenceCache[text] = parsed).seq;
+}
+
+void scan(const jsonValue &request, const string &id, FILE *out)
+{
+    auto start = chrono::steady_clock::now();
+    const map<string, jsonValue> &fields = request.object;
+
+    // Sequence text, read fresh from file so edits are picked up (waveform files are
+    // checked by getSequence)
+    string text;
+    if (fields.count("sequence"))
+        text = fields.at("sequence").str;
+    else if (fields.count("config"))
+    {
+        ifstream infile(fields.at("config").str);
+        if (!infile)
+            throw runtime_error("could not open " + fields.at("config").str);
+        text.assign(istreambuf_iterator<char>(infile), istreambuf_iterator<char>());
+    }
+    else
+        throw runtime_error("scan needs a \"sequence\" or \"config\"");
+    string stamp;
+    pulseSequence seq = getSequence(text, stamp);
+
+    // Fixed parameters, also part of every result key
+    string key = text + "\n" + stamp + "\n";
+    if (fields.count("set"))
+    {
+        for (auto &param : fields.at("set").object)
+        {
+            double value = getNumber(param.second, param.first);
+            seq.setParameter(param.first, value);
+            key += param.first + "=" + formatNumber(value, 17) + ";";
+        }
+    }
+
+    // Scan axis
+    string axis = fields.count("axis") ? fields.at("axis").str : seq.getScanAxis();
+    vector<double> values;
+    if (fields.count("values"))
+    {
+        for (auto &value : fields.at("values").array)
+            values.push_back(getNumber(value, "values"));
+    }
+    else if (fields.count("num"))
+    {
+        int num = (int)getNumber(fields.at("num"), "num");
+        double first = fields.count("start") ? getNumber(fields.at("start"), "start") : 0;
+        double last = fields.count("end") ? getNumber(fields.at("end"), "end") : first;
+        for (int i = 0; i < num; i++)
+            values.push_back(num == 1 ? first : first + (double)i * (last - first) / (double)(num - 1));
+    }
+    else if (axis == seq.getScanAxis())
+        values = seq.getScanRange();
+    if (axis.empty())
+        throw runtime_error("scan needs an \"axis\" or a scan line in the sequence");
+    checkParameter(axis);
+    if (values.empty() && !fields.count("values") && !fields.count("num"))
+        throw runtime_error("axis " + axis + " needs \"values\" or \"num\"");
+    seq.checkScan(axis, values);
+
+    // Send cached points straight away, compute the rest on the pool
+    vector<int> todo;
+    vector<string> keys(values.size());
+    for (int i = 0; i < values.size(); i++)
+    {
+        keys[i] = key + axis + "=" + formatNumber(values[i], 17);
+        lock_guard<mutex> lock(resultLock);
+        auto entry = resultCache.find(keys[i]);
+        if (entry == resultCache.end())
+        {
+            todo.push_back(i);
+            continue;
+        }
+        respond(out, "{\"id\":" + id + ",\"i\":" + to_string(i) + ",\"value\":" + formatNumber(values[i]) +
+                         ",\"xProb\":" + formatNumber(getXProb(entry->second)) +
+                         ",\"yProb\":" + formatNumber(getYProb(entry->second)) +
+                         ",\"zProb\":" + formatNumber(getZProb(entry->second)) + ",\"cached\":true}");
+    }
+    parallelFor(todo.size(), [&](int j) {
+        int i = todo[j];
+        pulseSequence point = seq;
+        point.setParameter(axis, values[i]);
+        vector<double> state = point.compile(axis).execute(seq.getKet(), &pulseCache);
+        {
+            lock_guard<mutex> lock(resultLock);
+            if (resultCache.size() >= MAX_RESULTS)
+                resultCache.clear();
+            resultCache[keys[i]] = state;
+        }
+        respond(out, "{\"id\":" + id + ",\"i\":" + to_string(i) + ",\"value\":" + formatNumber(values[i]) +
+                         ",\"xProb\":" + formatNumber(getXProb(state)) +
+                         ",\"yProb\":" + formatNumber(getYProb(state)) +
+                         ",\"zProb\":" + formatNumber(getZProb(state)) + ",\"cached\":false}");
+    });
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    respond(out, "{\"id\":" + id + ",\"done\":true,\"axis\":" + quoteJson(axis) +
+                     ",\"num\":" + to_string(values.size()) +
+                     ",\"cached\":" + to_string(values.size() - todo.size()) +
+                     ",\"seconds\":" + formatNumber(seconds) + "}");
+}
+
+bool serve(FILE *in, FILE *out)
+// Handles requests until end of input, true if asked to quit
+{
+    char *buffer = nullptr;
+    size_t size = 0;
+    bool quit = false;
+    while (!quit && getline(&buffer, &size, in) >= 0)
+    {
+        string line(buffer);
+        if (line.find_first_not_of(" \t\r\n") == string::npos)
+            continue;
+        string id = "null";
+        try
+        {
+            jsonValue request = parseJson(line);
+            if (request.type != 'o')
+                throw runtime_error("request must be a JSON object");
+            if (request.object.count("id"))
+                id = toJson(request.object["id"]);
+            string cmd = request.object.count("cmd") ? request.object["cmd"].str : "";
+
+            if (cmd == "scan")
+                scan(request, id, out);
+            else if (cmd == "stats")
+            {
+                lock_guard<mutex> lock(resultLock);
+                respond(out, "{\"id\":" + id + ",\"results\":" + to_string(resultCache.size()) +
+                                 ",\"sequences\":" + to_string(sequenceCache.size()) +
+                                 ",\"propagators\":" + to_string(pulseCache.getSize()) +
+                                 ",\"propagatorHits\":" + to_string(pulseCache.getHits()) +
+                                 ",\"propagatorMisses\":" + to_string(pulseCache.getMisses()) +
+                                 ",\"threads\":" + to_string(getThreadPool().getNumThreads()) + "}");
+            }
+            else if (cmd == "clear")
+            {
+                {
+                    lock_guard<mutex> lock(resultLock);
+                    resultCache.clear();
+                }
+                sequenceCache.clear();
+                pulseCache.clear();
+                respond(out, "{\"id\":" + id + ",\"done\":true}");
+            }
+            else if (cmd == "quit")
+            {
+                respond(out, "{\"id\":" + id + ",\"done\":true}");
+                quit = true;
+            }
+            else
+                throw runtime_error("unknown cmd '" + cmd + "', use scan, stats, clear or quit");
+        }
+        catch (const exception &err)
+        {
+            respond(out, "{\"id\":" + id + ",\"error\":" + quoteJson(err.what()) + "}");
+        }
+    }
+    free(buffer);
+    return quit;
+}
+
+// Minimal JSON reader, enough for the request format above
+
+void skipSpace(const string &text, size_t &pos)
+{
+    while (pos < text.size() && isspace((unsigned char)text[pos]))
+        pos++;
+}
+
+jsonValue parseJsonValue(const string &text, size_t &pos);
+
+string parseJsonString(const string &text, size_t &pos)
+{
+    string str;
+    pos++; // Opening quote
+    while (pos < text.size() && text[pos] != '"')
+    {
+        char c = text[pos++];
+        if (c == '\\' && pos < text.size())
+        {
+            c = text[pos++];
+            if (c == 'n')
+                c = '\n';
+            else if (c == 't')
+                c = '\t';
+            else if (c == 'r')
+                c = '\r';
+            else if (c == 'u')
+            {
+                // Only plain ASCII escapes are expected here
+                c = (char)stoi(text.substr(pos, 4), nullptr, 16);
+                pos += 4;
+            }
+        }
+        str += c;
+    }
+    if (pos >= text.size())
+        throw runtime_error("unterminated JSON string");
+    pos++; // Closing quote
+    return str;
+}
+
+jsonValue parseJsonValue(const string &text, size_t &pos)
+{
+    jsonValue value;
+    value.type = 0;
+    value.number = 0;
+    value.boolean = false;
+    skipSpace(text, pos);
+    if (pos >= text.size())
+        throw runtime_error("unexpected end of JSON");
+
+    char c = text[pos];
+    if (c == '{' || c == '[')
+    {
+        char close = (c == '{') ? '}' : ']';
+        value.type = (c == '{') ? 'o' : 'a';
+        pos++;
+        skipSpace(text, pos);
+        if (pos < text.size() && text[pos] == close)
+        {
+            pos++;
+            return value;
+        }
+        while (true)
+        {
+            skipSpace(text, pos);
+            if (value.type == 'o')
+            {
+                if (pos >= text.size() || text[pos] != '"')
+                    throw runtime_error("expected a JSON key");
+                string name = parseJsonString(text, pos);
+                skipSpace(text, pos);
+                if (pos >= text.size() || text[pos] != ':')
+                    throw runtime_error("expected ':' after JSON key");
+                pos++;
+                value.object[name] = parseJsonValue(text, pos);
+            }
+            else
+                value.array.push_back(parseJsonValue(text, pos));
+            skipSpace(text, pos);
+            if (pos < text.size() && text[pos] == ',')
+            {
+                pos++;
+                continue;
+            }
+            if (pos < text.size() && text[pos] == close)
+            {
+                pos++;
+                return value;
+            }
+            throw runtime_error("expected ',' or closing bracket in JSON");
+        }
+    }
+    if (c == '"')
+    {
+        value.type = 's';
+        value.str = parseJsonString(text, pos);
+    }
+    else if (text.compare(pos, 4, "true") == 0 || text.compare(pos, 5, "false") == 0)
+    {
+        value.type = 'b';
+        value.boolean = (c == 't');
+        pos += value.boolean ? 4 : 5;
+    }
+    else if (text.compare(pos, 4, "null") == 0)
+        pos += 4;
+    else
+    {
+        size_t end;
+        value.type = 'n';
+        try
+        {
+            value.number = stod(text.substr(pos), &end);
+        }
+        catch (const exception &)
+        {
+            throw runtime_error("invalid JSON value at '" + text.substr(pos, 10) + "'");
+        }
+        pos += end;
+    }
+    return value;
+}
+
+jsonValue parseJson(const string &text)
+{
+    size_t pos = 0;
+    jsonValue value = parseJsonValue(text, pos);
+    skipSpace(text, pos);
+    if (pos != text.size())
+        throw runtime_error("trailing characters after JSON");
+    return value;
+}
+
+string quoteJson(const string &str)
+{
+    string quoted = "\"";
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+            quoted += string("\\") + c;
+        else if (c == '\n')
+            quoted += "\\n";
+        else if ((unsigned char)c < 0x20)
+            quoted += ' ';
+        else
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+string toJson(const jsonValue &value)
+// Scalars only, used to echo request ids
+{
+    if (value.type == 'n')
+        return formatNumber(value.number);
+    if (value.type == 's')
+        return quoteJson(value.str);
+    if (value.type == 'b')
+        return value.boolean ? "true" : "false";
+    return "null";
+}
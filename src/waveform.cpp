@@ -0,0 +1,212 @@
+#include <vector>
+#include <string>
+#include <cmath>
+#include <complex>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include "neutron.hpp"
+#include "waveform.hpp"
+
+using namespace std;
+
+waveform::waveform(const int envelope, const double width)
+{
+    if (envelope < ENVELOPE_CONSTANT || envelope > ENVELOPE_GAUSSIAN)
+    {
+        throw runtime_error("waveform: unknown envelope " + to_string(envelope));
+    }
+    if (envelope == ENVELOPE_GAUSSIAN && width <= 0)
+    {
+        throw runtime_error("waveform: gaussian envelope needs width > 0");
+    }
+    _envelope = envelope;
+    _width = width;
+    _fileHash = 0;
+    setAmplitudeRamp(1, 1);
+    setPhaseRamp(0, 0);
+}
+
+waveform::waveform(const string &filename)
+// Same format as the program outputs: '#' comment lines, comma separated columns
+{
+    ifstream infile(filename);
+    string line;
+    if (!infile)
+    {
+        throw runtime_error("waveform: could not open " + filename);
+    }
+    while (getline(infile, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        replace(line.begin(), line.end(), ',', ' ');
+        istringstream columns(line);
+        double t, amp, phase = 0;
+        if (!(columns >> t >> amp))
+        {
+            throw runtime_error("waveform: could not parse '" + line + "' in " + filename);
+        }
+        columns >> phase;
+        if (!_tFile.empty() && t <= _tFile.back())
+        {
+            throw runtime_error("waveform: times in " + filename + " must be increasing");
+        }
+        _tFile.push_back(t);
+        _ampFile.push_back(amp);
+        _phaseFile.push_back(phase);
+    }
+    if (_tFile.size() < 2)
+    {
+        throw runtime_error("waveform: " + filename + " needs at least 2 samples");
+    }
+    _envelope = ENVELOPE_FILE;
+    _width = 0;
+    _fileHash = 0;
+    for (auto samples : {&_tFile, &_ampFile, &_phaseFile})
+    {
+        for (auto value : *samples)
+            _fileHash = _fileHash * 1000003 ^ hash<double>()(value);
+    }
+    setAmplitudeRamp(1, 1);
+    setPhaseRamp(0, 0);
+}
+
+void waveform::setAmplitudeRamp(const double a0, const double a1)
+// Changes the shape, so stop sharing the envelope table with earlier copies
+{
+    _ampRamp[0] = a0;
+    _ampRamp[1] = a1;
+    _cache = make_shared<envelopeCache>();
+}
+
+void waveform::setPhaseRamp(const double phi0, const double phi1)
+{
+    _phaseRamp[0] = phi0;
+    _phaseRamp[1] = phi1;
+    _cache = make_shared<envelopeCache>();
+}
+
+bool waveform::isConstant() const
+{
+    return _envelope == ENVELOPE_CONSTANT && _ampRamp[0] == 1 && _ampRamp[1] == 1 &&
+           _phaseRamp[0] == 0 && _phaseRamp[1] == 0;
+}
+
+double waveform::getAmplitude(const double t, const double time) const
+{
+    double frac = min(max(t / time, 0.0), 1.0);
+    double amp = _ampRamp[0] + (_ampRamp[1] - _ampRamp[0]) * frac;
+    if (_envelope == ENVELOPE_SIN2)
+    {
+        amp *= sin(PI * frac) * sin(PI * frac);
+    }
+    else if (_envelope == ENVELOPE_GAUSSIAN)
+    {
+        double x = (frac - 0.5) / _width;
+        amp *= exp(-x * x / 2);
+    }
+    else if (_envelope == ENVELOPE_FILE)
+    {
+        if (t < _tFile.front() || t > _tFile.back())
+            return 0;
+        int i = upper_bound(_tFile.begin(), _tFile.end(), t) - _tFile.begin();
+        i = min(i, (int)_tFile.size() - 1);
+        double s = (t - _tFile[i - 1]) / (_tFile[i] - _tFile[i - 1]);
+        amp *= _ampFile[i - 1] + s * (_ampFile[i] - _ampFile[i - 1]);
+    }
+    return amp;
+}
+
+double waveform::getPhase(const double t, const double time) const
+{
+    double frac = min(max(t / time, 0.0), 1.0);
+    double phase = _phaseRamp[0] + (_phaseRamp[1] - _phaseRamp[0]) * frac;
+    if (_envelope == ENVELOPE_FILE && t >= _tFile.front() && t <= _tFile.back())
+    {
+        int i = upper_bound(_tFile.begin(), _tFile.end(), t) - _tFile.begin();
+        i = min(i, (int)_tFile.size() - 1);
+        double s = (t - _tFile[i - 1]) / (_tFile[i] - _tFile[i - 1]);
+        phase += _phaseFile[i - 1] + s * (_phaseFile[i] - _phaseFile[i - 1]);
+    }
+    return phase;
+}
+
+double waveform::getMeanAmplitude(const double time) const
+// Trapezoid rule, for rescaling wRF so a shaped pulse has the tip angle of a square one
+{
+    if (isConstant())
+        return 1;
+    const int numSamples = 10000;
+    double sum = 0.5 * (getAmplitude(0, time) + getAmplitude(time, time));
+    for (int i = 1; i < numSamples; i++)
+        sum += getAmplitude(time * (double)i / numSamples, time);
+    return sum / numSamples;
+}
+
+string waveform::getKey() const
+{
+    ostringstream key;
+    key.precision(17);
+    key << _envelope << "," << _width << "," << _ampRamp[0] << "," << _ampRamp[1] << ","
+        << _phaseRamp[0] << "," << _phaseRamp[1] << "," << _fileHash;
+    return key.str();
+}
+
+shared_ptr<const vector<complex<double>>> waveform::getEnvelopeTable(const double time, const double dt,
+                                                                      const int numSamples) const
+// One table per (time, dt), built outside the lock so threads sampling other pulse
+// lengths don't wait. Tables are never changed once stored, callers keep their pointer
+{
+    {
+        lock_guard<mutex> lock(_cache->lock);
+        auto entry = _cache->tables.find({time, dt});
+        if (entry != _cache->tables.end() && entry->second->size() == numSamples)
+            return entry->second;
+    }
+
+    auto table = make_shared<vector<complex<double>>>(numSamples);
+    for (int k = 0; k < numSamples; k++)
+    {
+        double t = (double)k * dt / 2;
+        double phase = getPhase(t, time);
+        (*table)[k] = getAmplitude(t, time) * complex<double>(cos(phase), sin(phase));
+    }
+
+    lock_guard<mutex> lock(_cache->lock);
+    if (_cache->tables.size() >= ENVELOPE_CACHE_SIZE)
+        _cache->tables.clear();
+    _cache->tables[{time, dt}] = table;
+    return table;
+}
+
+void waveform::getPhasorTable(const double time, const double dt, const int numSteps,
+                              const vector<double> &params, vector<double> &table) const
+// The carrier exp(i(w*t + phi)) is advanced by a fixed rotation per half step and
+// re-anchored with exact trig every PHASOR_RENORM samples to stop rounding drift
+{
+    int numSamples = 2 * numSteps + 1;
+    double h = dt / 2;
+    complex<double> rotator(cos(params[0] * h), sin(params[0] * h));
+    complex<double> carrier;
+    shared_ptr<const vector<complex<double>>> envelope;
+    if (!isConstant())
+        envelope = getEnvelopeTable(time, dt, numSamples);
+
+    table.resize(2 * numSamples);
+    for (int k = 0; k < numSamples; k++)
+    {
+        if (k % PHASOR_RENORM == 0)
+            carrier = polar(1.0, params[0] * (double)k * h + params[3]);
+        else
+            carrier *= rotator;
+
+        complex<double> rf = params[2] * carrier;
+        if (envelope)
+            rf *= (*envelope)[k];
+        table[2 * k] = rf.real();
+        table[2 * k + 1] = rf.imag();
+    }
+}